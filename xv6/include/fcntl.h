@@ -8,4 +8,9 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 
+// Protection for mmap
+
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+
 #endif //_FCNTL_H_
@@ -52,4 +52,26 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A directory whose dinode major is DIR_HASHED is an extendible
+// hash table.  Block 0 holds a struct dirhhdr; entry i of its
+// table is the block for names whose hash (see dirhash in
+// kernel/fs.c) ends in the depth bits i.  When an insert finds
+// that block full, the block splits in two on the next bit of
+// the hash, and the table doubles if it must.  So a lookup
+// reads the header and one block, however large the directory.
+// It holds up to (MAXFILE-1)*BSIZE/sizeof(struct dirent)
+// entries, a few less than a plain directory, and fewer if
+// more than a block's worth of names share DIRHDEPTH hash bits.
+#define DIR_HASHED 1
+#define DIRHDEPTH  8  // most hash bits the table may use
+
+// Header of a hashed directory.  It is kept in the name fields
+// of block 0's dirent slots, whose inums are 0, so that whoever
+// reads the directory as dirents sees no entries there.
+struct dirhhdr {
+  uchar depth;                  // hash bits the table uses
+  uchar table[1 << DIRHDEPTH];  // block for each value of them
+  uchar ldepth[MAXFILE];        // hash bits block's names share
+};
+
 #endif // _FS_H_
@@ -8,12 +8,34 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NBUF         10  // size of disk block cache
-#define NINODE       50  // maximum number of active i-nodes
+#define NBUF         10  // minimum size of disk block cache
+#define BCACHEPCT     2  // percent of memory for the disk block cache
+#define BFLUSHTICKS 100  // how often the flusher looks for old dirty blocks
+#define BDIRTYTICKS 300  // how long a block may stay dirty in the cache
+#define RAMIN         8  // first read-ahead window, in blocks
+#define RAMAX        64  // largest read-ahead window, in blocks
+#define IDEDMA        1  // use bus-master DMA if the IDE controller can
+#define IDEDEADLINE  50  // ticks a read waits before it jumps the elevator
+#define IDETIMEOUT  300  // ticks a disk command may stall before a reset
+#define NINODE      500  // maximum number of in-core i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
-#define USERTOP  0xA0000 // end of user address space
-#define PHYSTOP  0x1000000 // use phys mem up to here as free pool
+#define VIRTIODEV     4  // device number of the virtio disk, root if present
+#define NBDEV         8  // maximum number of disks
+#define NMOUNT        4  // maximum number of mounted file systems
+#define USERTOP  0x80000000 // end of user address space (KERNBASE)
 #define MAXARG       32  // max exec arguments
+#define SWAPDEV       0  // disk holding the swap area
+#define SWAPSTART 10000  // first sector of swap area, after the kernel
+#define NSWAP      4096  // pages of swap space (16MB)
+#define NSHM         16  // maximum number of shared memory segments
+#define SHMMAX  (1024*1024) // maximum size of a shared memory segment
+#define SHMNAME      16  // maximum length of a segment name
+#define SHMBASE  (USERTOP - NSHM*SHMMAX) // segments are mapped above here
+#define NMMAP         8  // file mappings per process
+#define MMAPMAX (128*1024) // maximum length of a file mapping
+#define MMAPBASE (SHMBASE - NMMAP*MMAPMAX) // file mappings go above here
+#define NPCACHE     256  // pages in the file page cache
+#define NDCACHE     256  // entries in the directory entry cache
 
 #endif // _PARAM_H_
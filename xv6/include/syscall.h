@@ -24,5 +24,21 @@
 #define SYS_sleep  20
 #define SYS_uptime 21
 #define SYS_getpinfo 22
+#define SYS_sysinfo 23
+#define SYS_shmcreate 24
+#define SYS_shmattach 25
+#define SYS_shmdetach 26
+#define SYS_mmap   27
+#define SYS_munmap 28
+#define SYS_clone  29
+#define SYS_join   30
+#define SYS_futex_wait 31
+#define SYS_futex_wake 32
+#define SYS_bcachesize 33
+#define SYS_sync   34
+#define SYS_fsync  35
+#define SYS_iosched 36
+#define SYS_mount  37
+#define SYS_mkhashdir 38
 
 #endif // _SYSCALL_H_
@@ -0,0 +1,35 @@
+#ifndef _SYSINFO_H_
+#define _SYSINFO_H_
+
+// System-wide statistics, filled in by the sysinfo system call.
+struct sysinfo {
+  uint totalram;  // bytes of physical memory managed by kalloc
+  uint freeram;   // bytes of physical memory currently free
+  uint zeroram;   // bytes of free memory already zeroed
+  uint totalswap; // bytes of swap space
+  uint freeswap;  // bytes of swap space not holding a page
+  uint nswapin;   // pages read back in from swap since boot
+  uint nswapout;  // pages written out to swap since boot
+  uint nbuf;      // buffers in the disk block cache
+  uint nbhit;     // block lookups the cache satisfied
+  uint nbmiss;    // block lookups that recycled a buffer
+  uint nbdirty;   // buffers waiting to be written back
+  uint nbahead;   // blocks read ahead of sequential readers
+  uint idecycles; // CPU cycles spent in the disk driver, / 1024
+  int idedma;     // the disk driver uses bus-master DMA
+  uint ideerrors; // disk errors and timeouts recovered from
+  uint idereqs;   // disk requests queued since boot
+  uint idedepth;  // sum of the queue depths those requests found
+  uint idecmds;   // disk commands started since boot
+  uint ideseek;   // sum of the sectors the heads moved between them
+  char iosched[8]; // name of the disk request scheduler
+  uint fsblocks;  // blocks in the root file system
+  uint fsfree;    // of those, blocks free
+  uint ninode;    // in-core inodes
+  uint niread;    // inodes read from disk
+  uint ndchit;    // path lookups the dentry cache found an inode for
+  uint ndcneg;    // ... found no entry for
+  uint ndcmiss;   // ... had to read the directory for
+};
+
+#endif // _SYSINFO_H_
@@ -11,6 +11,15 @@ inb(ushort port)
   return data;
 }
 
+static inline ushort
+inw(ushort port)
+{
+  ushort data;
+
+  asm volatile("in %1,%0" : "=a" (data) : "d" (port));
+  return data;
+}
+
 static inline void
 insl(int port, void *addr, int cnt)
 {
@@ -32,6 +41,21 @@ outw(ushort port, ushort data)
   asm volatile("out %0,%1" : : "a" (data), "d" (port));
 }
 
+static inline uint
+inl(ushort port)
+{
+  uint data;
+
+  asm volatile("in %1,%0" : "=a" (data) : "d" (port));
+  return data;
+}
+
+static inline void
+outl(ushort port, uint data)
+{
+  asm volatile("out %0,%1" : : "a" (data), "d" (port));
+}
+
 static inline void
 outsl(int port, const void *addr, int cnt)
 {
@@ -41,6 +65,15 @@ outsl(int port, const void *addr, int cnt)
                "cc");
 }
 
+static inline uint64
+rdtsc(void)
+{
+  uint64 t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
 static inline void
 stosb(void *addr, int data, int cnt)
 {
@@ -153,6 +186,58 @@ rcr0(void)
   return val;
 }
 
+static inline void
+lcr4(uint val)
+{
+  asm volatile("movl %0,%%cr4" : : "r" (val));
+}
+
+static inline uint
+rcr4(void)
+{
+  uint val;
+  asm volatile("movl %%cr4,%0" : "=r" (val));
+  return val;
+}
+
+static inline void
+clts(void)
+{
+  asm volatile("clts");
+}
+
+static inline void
+cpuid(uint info, uint *eaxp, uint *ebxp, uint *ecxp, uint *edxp)
+{
+  uint eax, ebx, ecx, edx;
+
+  asm volatile("cpuid" :
+               "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) :
+               "a" (info));
+  if(eaxp)
+    *eaxp = eax;
+  if(ebxp)
+    *ebxp = ebx;
+  if(ecxp)
+    *ecxp = ecx;
+  if(edxp)
+    *edxp = edx;
+}
+
+// Save and restore the x87/SSE registers to and from a
+// 512-byte, 16-byte aligned area.
+static inline void
+fxsave(void *area)
+{
+  asm volatile("fxsave %0" : "=m" (*(char(*)[512])area));
+}
+
+static inline void
+fxrstor(void *area)
+{
+  asm volatile("fxrstor %0" : : "m" (*(char(*)[512])area));
+}
+
 static inline uint
 rcr2(void)
 {
@@ -1,17 +1,20 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 // 
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to flush it to disk.
+// * After changing buffer data, call bwrite to schedule it
+//     to be written to disk.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * bsync and bsyncblock write dirty blocks out right away.
+// * breadahead starts reading a block that will be wanted soon.
 // 
 // The implementation uses three state flags internally:
 // * B_BUSY: the block has been returned from bread
@@ -20,76 +23,389 @@
 //     with the associated disk block contents.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// The hash table has NBHASH buckets, each with its own lock, so
+// processes using different blocks rarely share a lock.  Every
+// buffer is on the chain of the bucket for its (dev, sector);
+// spare buffers have dev -1 and are spread over the buckets.
+// Buffers that are neither B_BUSY nor B_DIRTY are also on their
+// bucket's free list, least recently used last.  A cache hit
+// and brelse take only the bucket lock.
+//
+// A miss takes bcache.lock, which serializes recycling: the
+// victim is the oldest of the buckets' least recently used
+// buffers, moved to the bucket of its new block.  Only a
+// process holding bcache.lock takes two bucket locks at once.
+// The buffers come a page at a time from kalloc: binit sizes
+// the cache to BCACHEPCT percent of memory, and bcachesize
+// grows or shrinks it later.  If every buffer is busy, bget
+// sleeps.
+//
+// Writes are delayed.  bwrite only marks the buffer dirty and
+// puts it on the dirty list, oldest first, so a block written
+// many times in a row goes to disk once.  The flusher thread
+// (bflushd) writes back blocks that have been dirty for
+// BDIRTYTICKS, and all of them when more than half the cache is
+// dirty.  bget writes a dirty buffer itself only when there is
+// no clean one to recycle.
+//
+// Locks are taken in the order bcache.lock, bcache.dirtylock,
+// bucket lock.
+//
+// Blocks go to and from the disks through blkrw, which hands
+// them to the driver that bdevsw names for their disk.  Each
+// driver keeps its own request queues.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "buf.h"
+#include "sysinfo.h"
 
-struct {
+struct bdevsw bdevsw[NBDEV];
+
+#define NBHASH 128
+#define BHASH(dev, sector) (((dev)*31 + (sector)) % NBHASH)
+
+// A page of buffers.
+struct bufpage {
+  struct bufpage *next;
+  struct buf buf[(PGSIZE - sizeof(struct bufpage*)) / sizeof(struct buf)];
+};
+
+#define BPP NELEM(((struct bufpage*)0)->buf)
+
+struct bbucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *chain;  // through hnext
+  // Circular list of free buffers, through prev/next.  lru is
+  // the most recently used, lru->prev the least.
+  struct buf *lru;
+  uint nhit;          // bget found the block here
+  uint nahead;        // breadahead started a read here
+};
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+struct {
+  struct spinlock lock;   // recycling and resizing
+  struct bufpage *pages;
+  uint nbuf;
+  int nwait;   // processes waiting for a free buffer
+  uint nmiss;  // bget had to recycle a buffer
+
+  struct bbucket bucket[NBHASH];
+
+  // Linked list of dirty buffers, through dprev/dnext.
+  // dirty.dnext was dirtied first.
+  struct spinlock dirtylock;
+  struct buf dirty;
+  uint ndirty;
+  int flushwant;  // the flusher should write everything
 } bcache;
 
+#define BUCKET(dev, sector) (&bcache.bucket[BHASH(dev, sector)])
+
 void
 binit(void)
 {
-  struct buf *b;
+  struct sysinfo si;
+  struct bbucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  initlock(&bcache.dirtylock, "bdirty");
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBHASH]; bk++)
+    initlock(&bk->lock, "bbucket");
+  bcache.dirty.dprev = &bcache.dirty;
+  bcache.dirty.dnext = &bcache.dirty;
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    b->dev = -1;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  kmemstat(&si);
+  bcachesize(si.totalram / 100 * BCACHEPCT / PGSIZE * BPP);
+  cprintf("bcache: %d buffers\n", bcache.nbuf);
+}
+
+// Put b on bk's free list as the most recently used.  Caller
+// holds bk->lock.
+static void
+lruadd(struct bbucket *bk, struct buf *b)
+{
+  if(bk->lru == 0){
+    b->next = b;
+    b->prev = b;
+  } else {
+    b->next = bk->lru;
+    b->prev = bk->lru->prev;
+    b->prev->next = b;
+    b->next->prev = b;
   }
+  bk->lru = b;
 }
 
-// Look through buffer cache for sector on device dev.
-// If not found, allocate fresh block.
-// In either case, return locked buffer.
+// Take b off bk's free list.  Caller holds bk->lock.
+static void
+lrudel(struct bbucket *bk, struct buf *b)
+{
+  if(b->next == b){
+    bk->lru = 0;
+    return;
+  }
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  if(bk->lru == b)
+    bk->lru = b->next;
+}
+
+// Find the buffer for sector of dev in bk.  Caller holds
+// bk->lock.
 static struct buf*
-bget(uint dev, uint sector)
+bfind(struct bbucket *bk, uint dev, uint sector)
+{
+  struct buf *b;
+
+  for(b = bk->chain; b; b = b->hnext)
+    if(b->dev == dev && b->sector == sector)
+      return b;
+  return 0;
+}
+
+// Remove b from bk's chain.  Caller holds bk->lock.
+static void
+bunhash(struct bbucket *bk, struct buf *b)
+{
+  struct buf **bp;
+
+  bp = &bk->chain;
+  while(*bp != b)
+    bp = &(*bp)->hnext;
+  *bp = b->hnext;
+}
+
+// Take b off the dirty list.  Caller holds bcache.dirtylock.
+static void
+bundirty(struct buf *b)
+{
+  b->dnext->dprev = b->dprev;
+  b->dprev->dnext = b->dnext;
+  b->dnext = 0;
+  bcache.ndirty--;
+}
+
+// Can the buffers in page g be given back?  Caller holds
+// every bucket lock.
+static int
+bpageidle(struct bufpage *g)
+{
+  int i;
+
+  for(i = 0; i < BPP; i++)
+    if(g->buf[i].flags & (B_BUSY|B_DIRTY))
+      return 0;
+  return 1;
+}
+
+// Grow or shrink the cache to about n buffers, a page of
+// buffers at a time, or leave it alone if n is 0.  Shrinking
+// gives back only pages whose buffers are all idle.  Returns
+// the new number of buffers.
+int
+bcachesize(int n)
 {
+  struct bufpage *g, **gp;
+  struct bbucket *bk;
   struct buf *b;
+  int i;
 
   acquire(&bcache.lock);
+  if(n == 0)
+    n = bcache.nbuf;
+  if(n < NBUF)
+    n = NBUF;
+  while(bcache.nbuf < n){
+    if((g = (struct bufpage*)kalloc()) == 0)
+      break;
+    memset(g, 0, PGSIZE);
+    for(i = 0; i < BPP; i++){
+      b = &g->buf[i];
+      b->dev = -1;
+      b->sector = bcache.nbuf + i;
+      bk = BUCKET(b->dev, b->sector);
+      acquire(&bk->lock);
+      b->hnext = bk->chain;
+      bk->chain = b;
+      lruadd(bk, b);
+      // Least recently used end: recycled first.
+      bk->lru = b->next;
+      release(&bk->lock);
+    }
+    g->next = bcache.pages;
+    bcache.pages = g;
+    bcache.nbuf += BPP;
+  }
+  if(bcache.nwait)
+    wakeup(&bcache);
+
+  if(bcache.nbuf >= n + BPP){
+    for(bk = bcache.bucket; bk < &bcache.bucket[NBHASH]; bk++)
+      acquire(&bk->lock);
+    for(gp = &bcache.pages; *gp && bcache.nbuf >= n + BPP; ){
+      g = *gp;
+      if(!bpageidle(g)){
+        gp = &g->next;
+        continue;
+      }
+      for(i = 0; i < BPP; i++){
+        b = &g->buf[i];
+        bk = BUCKET(b->dev, b->sector);
+        lrudel(bk, b);
+        bunhash(bk, b);
+      }
+      *gp = g->next;
+      bcache.nbuf -= BPP;
+      kfree((char*)g);
+    }
+    for(bk = bcache.bucket; bk < &bcache.bucket[NBHASH]; bk++)
+      release(&bk->lock);
+  }
+  n = bcache.nbuf;
+  release(&bcache.lock);
+  return n;
+}
+
+// Take the least recently used clean free buffer out of the
+// cache and return it busy, or return 0 if there is none.
+// Caller holds bcache.lock.
+static struct buf*
+bvictim(void)
+{
+  struct bbucket *bk, *best;
+  struct buf *b;
 
+  // Keep the lock of the best bucket so far, so that its
+  // buffer can't be taken while we look at the rest.
+  best = 0;
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBHASH]; bk++){
+    acquire(&bk->lock);
+    if(bk->lru && (best == 0 ||
+       (int)(bk->lru->prev->lastuse - best->lru->prev->lastuse) < 0)){
+      if(best)
+        release(&best->lock);
+      best = bk;
+    } else
+      release(&bk->lock);
+  }
+  if(best == 0)
+    return 0;
+  b = best->lru->prev;
+  lrudel(best, b);
+  bunhash(best, b);
+  b->flags = B_BUSY;
+  release(&best->lock);
+  return b;
+}
+
+// Find the oldest dirty buffer that is not busy and return it
+// busy, or return 0 if there is none.
+static struct buf*
+bdirtyvictim(void)
+{
+  struct bbucket *bk;
+  struct buf *b;
+
+  acquire(&bcache.dirtylock);
+  for(b = bcache.dirty.dnext; b != &bcache.dirty; b = b->dnext){
+    bk = BUCKET(b->dev, b->sector);
+    acquire(&bk->lock);
+    if(!(b->flags & B_BUSY)){
+      b->flags |= B_BUSY;
+      release(&bk->lock);
+      break;
+    }
+    release(&bk->lock);
+  }
+  release(&bcache.dirtylock);
+  return b == &bcache.dirty ? 0 : b;
+}
+
+// Look through buffer cache for sector on device dev.
+// If not found, recycle the least recently used free buffer,
+// writing back a dirty one if none is clean and waiting if
+// all are busy.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint sector)
+{
+  struct bbucket *bk;
+  struct buf *b, *d;
+
+  bk = BUCKET(dev, sector);
  loop:
   // Try for cached block.
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->sector == sector){
-      if(!(b->flags & B_BUSY)){
-        b->flags |= B_BUSY;
-        release(&bcache.lock);
-        return b;
-      }
-      sleep(b, &bcache.lock);
-      goto loop;
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, sector)) != 0){
+    if(!(b->flags & B_BUSY)){
+      b->flags |= B_BUSY;
+      if(!(b->flags & B_DIRTY))
+        lrudel(bk, b);
+      bk->nhit++;
+      release(&bk->lock);
+      return b;
     }
+    // Sleep under bk->lock: b can't change buckets while busy.
+    sleep(b, &bk->lock);
+    release(&bk->lock);
+    goto loop;
   }
+  release(&bk->lock);
 
-  // Allocate fresh block.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if((b->flags & B_BUSY) == 0){
-      b->dev = dev;
-      b->sector = sector;
-      b->flags = B_BUSY;
+  // Recycle a buffer.  Only holders of bcache.lock add blocks
+  // to the cache, so once the block is not there it can't
+  // appear until we put it there.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  b = bfind(bk, dev, sector);
+  release(&bk->lock);
+  if(b){
+    release(&bcache.lock);
+    goto loop;
+  }
+  if((b = bvictim()) == 0){
+    // brelse wakes us if nwait is set, so set it before
+    // looking again.
+    d = 0;
+    bcache.nwait++;
+    if((b = bvictim()) == 0 && (d = bdirtyvictim()) == 0)
+      sleep(&bcache, &bcache.lock);
+    bcache.nwait--;
+    if(b == 0){
+      // Clean the oldest idle dirty buffer, which brelse puts
+      // on the free list, and start over.
       release(&bcache.lock);
-      return b;
+      if(d){
+        blkrw(d);
+        brelse(d);
+      }
+      goto loop;
     }
   }
-  panic("bget: no buffers");
+  b->dev = dev;
+  b->sector = sector;
+  acquire(&bk->lock);
+  b->hnext = bk->chain;
+  bk->chain = b;
+  release(&bk->lock);
+  bcache.nmiss++;
+  release(&bcache.lock);
+  return b;
+}
+
+// Read or write b, and the bufs on its rwnext list, on the
+// disk holding them: see iderw.
+void
+blkrw(struct buf *b)
+{
+  if(b->dev >= NBDEV || bdevsw[b->dev].rw == 0)
+    panic("blkrw: no such disk");
+  bdevsw[b->dev].rw(b);
 }
 
 // Return a B_BUSY buf with the contents of the indicated disk sector.
@@ -100,39 +416,227 @@ bread(uint dev, uint sector)
 
   b = bget(dev, sector);
   if(!(b->flags & B_VALID))
-    iderw(b);
+    blkrw(b);
+  return b;
+}
+
+// Return a B_BUSY buf for sector of dev filled with zeros,
+// without reading the disk: for a block just allocated.  The
+// caller marks it for writing with bwrite.
+struct buf*
+bzero(uint dev, uint sector)
+{
+  struct buf *b;
+
+  b = bget(dev, sector);
+  memset(b->data, 0, sizeof(b->data));
+  b->flags |= B_VALID;
   return b;
 }
 
-// Write b's contents to disk.  Must be locked.
+// Start reading sector of dev into the cache, unless it is
+// there already, without waiting for the disk.
+void
+breadahead(uint dev, uint sector)
+{
+  struct bbucket *bk;
+  struct buf *b;
+
+  bk = BUCKET(dev, sector);
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, sector)) == 0)
+    bk->nahead++;
+  release(&bk->lock);
+  if(b)
+    return;
+  b = bget(dev, sector);
+  if(b->flags & B_VALID){
+    brelse(b);
+    return;
+  }
+  b->flags |= B_ASYNC;
+  blkrw(b);
+}
+
+// Mark b's contents to be written to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if((b->flags & B_BUSY) == 0)
     panic("bwrite");
-  b->flags |= B_DIRTY;
-  iderw(b);
+  acquire(&bcache.dirtylock);
+  if(!(b->flags & B_DIRTY)){
+    b->flags |= B_DIRTY;
+    b->dirtied = ticks;
+    b->dnext = &bcache.dirty;
+    b->dprev = bcache.dirty.dprev;
+    bcache.dirty.dprev->dnext = b;
+    bcache.dirty.dprev = b;
+    if(++bcache.ndirty > bcache.nbuf / 2)
+      bcache.flushwant = 1;
+  }
+  release(&bcache.dirtylock);
 }
 
 // Release the buffer b.
 void
 brelse(struct buf *b)
 {
+  struct bbucket *bk;
+
   if((b->flags & B_BUSY) == 0)
     panic("brelse");
 
-  acquire(&bcache.lock);
-
-  b->next->prev = b->prev;
-  b->prev->next = b->next;
-  b->next = bcache.head.next;
-  b->prev = &bcache.head;
-  bcache.head.next->prev = b;
-  bcache.head.next = b;
+  // A buffer that has just been written leaves the dirty list.
+  if(!(b->flags & B_DIRTY) && b->dnext){
+    acquire(&bcache.dirtylock);
+    bundirty(b);
+    release(&bcache.dirtylock);
+  }
 
+  bk = BUCKET(b->dev, b->sector);
+  acquire(&bk->lock);
+  if(!(b->flags & B_DIRTY)){
+    b->lastuse = ticks;
+    lruadd(bk, b);
+    // File data whose page is cached is kept there, not twice:
+    // make b the bucket's, and likely the cache's, next victim.
+    if(b->flags & B_COLD){
+      b->lastuse -= 0x40000000;
+      bk->lru = b->next;
+    }
+  }
   b->flags &= ~B_BUSY;
   wakeup(b);
+  release(&bk->lock);
 
-  release(&bcache.lock);
+  if(bcache.nwait){
+    acquire(&bcache.lock);
+    wakeup(&bcache);
+    release(&bcache.lock);
+  }
+}
+
+// Write back the buffers that became dirty no later than tick
+// before.  The writes are queued together, so that the disk
+// can merge those for neighbouring sectors; ideintr releases
+// the buffers.  Busy buffers are skipped, unless wait is set:
+// then wait for them and for the queued writes to finish.
+static void
+bflush(uint before, int wait)
+{
+  struct bbucket *bk;
+  struct buf *b;
+
+  // Holding dirtylock keeps every buffer on the list, since
+  // brelse needs it to take a written buffer off.
+  acquire(&bcache.dirtylock);
+  for(b = bcache.dirty.dnext; b != &bcache.dirty; b = b->dnext){
+    if((int)(b->dirtied - before) > 0)
+      break;
+    // A dirty buffer stays in its bucket until written.
+    bk = BUCKET(b->dev, b->sector);
+    acquire(&bk->lock);
+    if(!(b->flags & B_BUSY)){
+      b->flags |= B_BUSY|B_ASYNC;
+      blkrw(b);
+    }
+    release(&bk->lock);
+  }
+
+  while(wait){
+    b = bcache.dirty.dnext;
+    if(b == &bcache.dirty || (int)(b->dirtied - before) > 0)
+      break;
+    bk = BUCKET(b->dev, b->sector);
+    acquire(&bk->lock);
+    release(&bcache.dirtylock);
+    if(b->flags & B_BUSY){
+      sleep(b, &bk->lock);
+      release(&bk->lock);
+    } else {
+      b->flags |= B_BUSY;
+      release(&bk->lock);
+      blkrw(b);
+      brelse(b);
+    }
+    acquire(&bcache.dirtylock);
+  }
+  release(&bcache.dirtylock);
+}
+
+// Write every dirty buffer to disk.
+void
+bsync(void)
+{
+  bflush(ticks, 1);
+}
+
+// Write sector of dev to disk if the cache holds it dirty.
+void
+bsyncblock(uint dev, uint sector)
+{
+  struct bbucket *bk;
+  struct buf *b;
+
+  bk = BUCKET(dev, sector);
+  acquire(&bk->lock);
+  while((b = bfind(bk, dev, sector)) != 0 && (b->flags & B_DIRTY)){
+    if(!(b->flags & B_BUSY)){
+      b->flags |= B_BUSY;
+      release(&bk->lock);
+      blkrw(b);
+      brelse(b);
+      return;
+    }
+    sleep(b, &bk->lock);
+  }
+  release(&bk->lock);
 }
 
+// The flusher, a kernel thread.  Every BFLUSHTICKS it writes
+// back the buffers that have been dirty for BDIRTYTICKS, or all
+// of them if bwrite found too many dirty.
+void
+bflushd(void)
+{
+  uint last, before;
+
+  last = 0;
+  for(;;){
+    acquire(&tickslock);
+    while(ticks - last < BFLUSHTICKS && !bcache.flushwant)
+      sleep(&ticks, &tickslock);
+    last = ticks;
+    release(&tickslock);
+
+    acquire(&bcache.dirtylock);
+    before = bcache.flushwant ? last : last - BDIRTYTICKS;
+    bcache.flushwant = 0;
+    release(&bcache.dirtylock);
+    bflush(before, 0);
+  }
+}
+
+// Report buffer cache statistics for the sysinfo system call.
+void
+bstat(struct sysinfo *si)
+{
+  struct bbucket *bk;
+
+  acquire(&bcache.lock);
+  si->nbuf = bcache.nbuf;
+  si->nbmiss = bcache.nmiss;
+  release(&bcache.lock);
+  si->nbhit = 0;
+  si->nbahead = 0;
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBHASH]; bk++){
+    acquire(&bk->lock);
+    si->nbhit += bk->nhit;
+    si->nbahead += bk->nahead;
+    release(&bk->lock);
+  }
+  acquire(&bcache.dirtylock);
+  si->nbdirty = bcache.ndirty;
+  release(&bcache.dirtylock);
+}
@@ -8,6 +8,7 @@
 #include "types.h"
 #include "elf.h"
 #include "x86.h"
+#include "memlayout.h"
 
 #define SECTSIZE  512
 
@@ -31,10 +32,12 @@ bootmain(void)
     return;  // let bootasm.S handle error
 
   // Load each program segment (ignores ph flags).
+  // The kernel is linked at KERNBASE and up; load it at the
+  // physical address below that.
   ph = (struct proghdr*)((uchar*)elf + elf->phoff);
   eph = ph + elf->phnum;
   for(; ph < eph; ph++){
-    va = (uchar*)ph->va;
+    va = (uchar*)V2P(ph->va);
     readseg(va, ph->filesz, ph->offset);
     if(ph->memsz > ph->filesz)
       stosb(va + ph->filesz, 0, ph->memsz - ph->filesz);
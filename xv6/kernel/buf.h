@@ -5,13 +5,31 @@ struct buf {
   int flags;
   uint dev;
   uint sector;
-  struct buf *prev; // LRU cache list
+  struct buf *prev; // LRU free list of its hash bucket
   struct buf *next;
+  struct buf *hnext; // hash chain
+  struct buf *dprev; // dirty list
+  struct buf *dnext;
+  uint dirtied;      // ticks when it became dirty
+  uint lastuse;      // ticks when last released
   struct buf *qnext; // disk queue
+  uint qtime;        // ticks when queued for the disk
+  struct buf *rwnext; // next buf handed to blkrw with this one
   uchar data[512];
 };
 #define B_BUSY  0x1  // buffer is locked by some process
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // nobody waits for the disk; ideintr releases it
+#define B_COLD  0x10 // the page cache has a copy; reuse it first
+
+// Disk drivers, by disk number, like devsw for character devices.
+struct bdevsw {
+  void (*rw)(struct buf*);  // read or write b and the bufs
+                            // on its rwnext list, as iderw does
+  uint nsect;               // sectors on the disk
+};
+
+extern struct bdevsw bdevsw[];
 
 #endif // _BUF_H_
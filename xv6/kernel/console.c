@@ -10,6 +10,7 @@
 #include "fs.h"
 #include "file.h"
 #include "mmu.h"
+#include "memlayout.h"
 #include "proc.h"
 #include "x86.h"
 
@@ -118,7 +119,7 @@ panic(char *s)
 
 #define BACKSPACE 0x100
 #define CRTPORT 0x3d4
-static ushort *crt = (ushort*)0xb8000;  // CGA memory
+static ushort *crt = (ushort*)P2V(0xb8000);  // CGA memory
 
 static void
 cgaputc(int c)
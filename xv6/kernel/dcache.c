@@ -0,0 +1,201 @@
+// Directory entry cache.
+//
+// Remembers what looking up a name in a directory found: the
+// inode number and offset of its entry, or that there is no
+// such entry (a negative entry, inum 0).  dirlookup asks here
+// before reading the directory, so resolving the same path
+// again, or failing to find the same name again, reads no
+// directory blocks.  Entries are found through a hash on
+// (dev, dir, name) and are all on one LRU list; the least
+// recently used entry is reused when a new one is needed.
+//
+// Interface:
+// * dclookup(dev, dir, name, ...) returns what the cache knows.
+// * dcenter records what dirlookup found, or what dirlink and
+//   unlink changed.  Callers hold the directory's lock, so
+//   entries of one directory change in order.
+// * dcpurge(dev, dir) forgets a directory that has been freed,
+//   before its inode number can be reused.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "sysinfo.h"
+
+#define NDHASH 61
+
+struct dentry {
+  uint dev;
+  uint dir;              // inode number of the directory, 0 if unused
+  char name[DIRSIZ];
+  uint inum;             // inode number, 0 if there is no entry
+  uint off;              // offset of the entry in dir
+  struct dentry *hnext;  // hash bucket
+  struct dentry *prev;   // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry entry[NDCACHE];
+  struct dentry *hash[NDHASH];
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently used.
+  struct dentry head;
+
+  uint nhit;             // lookups answered with an inode
+  uint nneg;             // lookups answered with no entry
+  uint nmiss;            // lookups the cache couldn't answer
+} dcache;
+
+static uint
+dchash(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev*31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+void
+dcinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.entry; d < dcache.entry+NDCACHE; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+// Move d to the front of the LRU list, or to the back if it is
+// unused.  Caller holds dcache.lock.
+static void
+dctouch(struct dentry *d)
+{
+  struct dentry *at;
+
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  at = d->dir ? &dcache.head : dcache.head.prev;
+  d->next = at->next;
+  d->prev = at;
+  at->next->prev = d;
+  at->next = d;
+}
+
+// Take d out of its hash bucket and mark it unused.
+// Caller holds dcache.lock.
+static void
+dcunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[dchash(d->dev, d->dir, d->name)]; *pp != d;
+      pp = &(*pp)->hnext)
+    ;
+  *pp = d->hnext;
+  d->dir = 0;
+}
+
+// Find the entry for name in dir.  Caller holds dcache.lock.
+static struct dentry*
+dcfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dchash(dev, dir, name)]; d; d = d->hnext)
+    if(d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Look up name in directory dir on dev.  Returns 0 and sets
+// *inum and *off if the cache knows; *inum is 0 if there is no
+// such entry.  Returns -1 if the directory must be read.
+int
+dclookup(uint dev, uint dir, char *name, uint *inum, uint *off)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    dcache.nmiss++;
+    release(&dcache.lock);
+    return -1;
+  }
+  *inum = d->inum;
+  *off = d->off;
+  if(d->inum)
+    dcache.nhit++;
+  else
+    dcache.nneg++;
+  dctouch(d);
+  release(&dcache.lock);
+  return 0;
+}
+
+// Record that name in directory dir on dev is inode inum, in
+// the entry at offset off, or that there is no such entry if
+// inum is 0.
+void
+dcenter(uint dev, uint dir, char *name, uint inum, uint off)
+{
+  struct dentry *d;
+  uint h;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    d = dcache.head.prev;
+    if(d->dir)
+      dcunhash(d);
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+    h = dchash(dev, dir, d->name);
+    d->hnext = dcache.hash[h];
+    dcache.hash[h] = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  dctouch(d);
+  release(&dcache.lock);
+}
+
+// Forget every entry of directory dir on dev.
+void
+dcpurge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.entry; d < dcache.entry+NDCACHE; d++){
+    if(d->dir == dir && d->dev == dev){
+      dcunhash(d);
+      dctouch(d);
+    }
+  }
+  release(&dcache.lock);
+}
+
+// Report cache statistics for the sysinfo system call.
+void
+dcstat(struct sysinfo *si)
+{
+  acquire(&dcache.lock);
+  si->ndchit = dcache.nhit;
+  si->ndcneg = dcache.nneg;
+  si->ndcmiss = dcache.nmiss;
+  release(&dcache.lock);
+}
@@ -5,16 +5,27 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct pcpage;
+struct pcidev;
 struct pipe;
 struct proc;
 struct spinlock;
 struct stat;
 struct pstat;
+struct sysinfo;
 
 // bio.c
+int             bcachesize(int);
 void            binit(void);
+void            blkrw(struct buf*);
 struct buf*     bread(uint, uint);
+struct buf*     bzero(uint, uint);
+void            bflushd(void) __attribute__((noreturn));
+void            breadahead(uint, uint);
 void            brelse(struct buf*);
+void            bstat(struct sysinfo*);
+void            bsync(void);
+void            bsyncblock(uint, uint);
 void            bwrite(struct buf*);
 
 // console.c
@@ -35,17 +46,41 @@ int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 
+// fpu.c
+void            fpuinit(void);
+void            fputrap(void);
+void            fpuswitchout(struct proc*);
+void            fpucopy(struct proc*);
+void            fpureset(void);
+
+// dcache.c
+void            dcinit(void);
+int             dclookup(uint, uint, char*, uint*, uint*);
+void            dcenter(uint, uint, char*, uint, uint);
+void            dcpurge(uint, uint);
+void            dcstat(struct sysinfo*);
+
 // fs.c
+void            dirhinit(struct inode*);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+void            fsstat(struct sysinfo*);
+struct inode*   ialloc(uint, short, uint);
 struct inode*   idup(struct inode*);
 void            iinit(void);
 void            ilock(struct inode*);
 void            iput(struct inode*);
+void            ireadahead(struct inode*, uint, uint);
+void            ireclaimd(void) __attribute__((noreturn));
+int             ireclaimwait(void);
+void            isync(struct inode*);
+extern uint     rootdev;
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
+void            ireadpage(struct inode*, uint, char*);
+void            iwritepage(struct inode*, uint, char*);
+int             mount(struct inode*, uint);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
@@ -53,10 +88,19 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, uint);
+int             futexwake(uint, int);
+void            futexevict(uint);
+
 // ide.c
 void            ideinit(void);
-void            ideintr(void);
+void            ideintr(int);
 void            iderw(struct buf*);
+void            idestat(struct sysinfo*);
+void            idetimer(void);
+int             iosched(char*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -65,8 +109,13 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_zeroed(void);
 void            kfree(char*);
-void            kinit(void);
+int             kzero(void);
+void            kinit1(void);
+void            kinit2(void);
+void            kmemstat(struct sysinfo*);
+extern uint     phystop;
 
 // kbd.c
 void            kbdintr(void);
@@ -76,15 +125,37 @@ int             cpunum(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(int);
+void            lapicipi(int, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
+// mmap.c
+char*           mmap(struct file*, uint, uint, int);
+int             munmap(char*, uint);
+void            mmapexit(void);
+int             mmapcopy(struct proc*);
+
 // mp.c
 extern int      ismp;
 int             mpbcpu(void);
 void            mpinit(void);
 void            mpstartthem(void);
 
+// pcache.c
+void            pcinit(void);
+struct pcpage*  pcget(struct inode*, uint);
+struct pcpage*  pclookup(struct inode*, uint);
+void            pcdup(struct pcpage*);
+void            pcput(struct pcpage*);
+void            pcdrop(struct inode*);
+
+// pci.c
+int             pcifind(int, int, struct pcidev*);
+int             pcifindclass(int, int, struct pcidev*);
+void            pcienable(struct pcidev*);
+uint            pciread(struct pcidev*, int);
+void            pciwrite(struct pcidev*, int, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -96,13 +167,18 @@ int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
 
 // proc.c
+int             clone(void(*)(void*), void*, void*);
 struct proc*    copyproc(struct proc*);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+int             join(void**);
 int             kill(int);
+void            killthreads(void);
+void            kproc(char*, void(*)(void));
 void            pinit(void);
 void            procdump(void);
+struct proc*    procleader(struct proc*);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
@@ -111,10 +187,23 @@ int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 int		getpinfo(struct pstat*);
+char*           procvictim(uint);
+void            vmlock(void);
+void            vmunlock(void);
+void            tlbshootdown(pde_t*);
+void            tlbintr(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// shm.c
+void            shminit(void);
+int             shmcreate(char*, int);
+char*           shmattach(int);
+int             shmdetach(char*);
+int             shmcopyuvm(pde_t*, pde_t*);
+void            shmfreevm(pde_t*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -133,6 +222,16 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(void);
+void            swaplock(void);
+void            swapunlock(void);
+int             swapalloc(void);
+void            swapfree(uint);
+void            swapread(uint, char*);
+void            swapwrite(uint, char*);
+void            swapstat(struct sysinfo*);
+
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
@@ -155,10 +254,14 @@ void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 
+// virtio.c
+int             virtioinit(void);
+int             virtiointr(int);
+void            virtiorw(struct buf*);
+
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
-void            vmenable(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
@@ -170,6 +273,13 @@ pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
+char*           uvmvictim(pde_t*, uint, uint*, uint);
+int             pagein(pde_t*, uint);
+int             pinuvm(char*, uint);
+void            unpinuvm(void);
+int             mapshared(pde_t*, uint, char**, int, int);
+void            unmapshared(pde_t*, uint, int);
+int             uvmdirty(pde_t*, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
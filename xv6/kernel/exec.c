@@ -17,6 +17,10 @@ exec(char *path, char **argv)
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
 
+  // The other threads would lose their memory.
+  if(proc->thread)
+    return -1;
+
   if((ip = namei(path)) == 0)
     return -1;
   ilock(ip);
@@ -81,6 +85,9 @@ exec(char *path, char **argv)
   safestrcpy(proc->name, last, sizeof(proc->name));
 
   // Commit to the user image.
+  killthreads();
+  mmapexit();
+  fpureset();
   oldpgdir = proc->pgdir;
   proc->pgdir = pgdir;
   proc->sz = sz;
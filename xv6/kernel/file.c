@@ -84,6 +84,35 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+// Just read n bytes at off of f: if the read carried on from
+// the previous one, widen the read-ahead window and read the
+// blocks in it ahead of time.  A read anywhere else closes the
+// window.  Caller holds f->ip's lock.
+static void
+filereadahead(struct file *f, uint off, int n)
+{
+  uint bn;
+
+  if(off == f->raoff){
+    f->rawin = f->rawin ? f->rawin*2 : RAMIN;
+    if(f->rawin > RAMAX)
+      f->rawin = RAMAX;
+  } else {
+    f->rawin = 0;
+    f->ranext = 0;
+  }
+  f->raoff = off + n;
+  if(f->rawin == 0)
+    return;
+  bn = f->raoff / BSIZE;
+  if(f->ranext < bn)
+    f->ranext = bn;
+  if(f->ranext < bn + f->rawin){
+    ireadahead(f->ip, f->ranext, bn + f->rawin);
+    f->ranext = bn + f->rawin;
+  }
+}
+
 // Read from file f.  Addr is kernel address.
 int
 fileread(struct file *f, char *addr, int n)
@@ -96,8 +125,10 @@ fileread(struct file *f, char *addr, int n)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
+    if((r = readi(f->ip, addr, f->off, n)) > 0){
+      filereadahead(f, f->off, r);
       f->off += r;
+    }
     iunlock(f->ip);
     return r;
   }
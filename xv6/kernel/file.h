@@ -8,6 +8,12 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  // Read-ahead state: where a sequential read would start, the
+  // window in blocks (0 if reads are not sequential) and the
+  // first block not yet read ahead.
+  uint raoff;
+  uint rawin;
+  uint ranext;
 };
 
 
@@ -25,6 +31,12 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  struct pcpage *pages;  // cached pages (see pcache.c)
+  struct inode *rnext;   // next waiting for ireclaimd
+  struct inode *hnext;   // next in hash bucket (see fs.c)
+  struct inode *lprev;   // LRU list of unheld inodes
+  struct inode *lnext;
 };
 
 #define I_BUSY 0x1
@@ -0,0 +1,95 @@
+// x87/SSE state for user processes, switched lazily.
+//
+// The kernel itself never touches the FPU (it is built with
+// -mno-sse -mno-mmx), so only user code needs its registers
+// preserved.  CR0.TS is set whenever a process starts running;
+// its first FPU or SSE instruction traps with T_DEVICE, and
+// fputrap loads the process's saved registers.  A process that
+// never uses the FPU never traps and never pays for fxsave.
+//
+// When a process leaves the CPU with TS clear it used the FPU
+// during its time slice, and fpuswitchout saves the registers
+// into p->fxstate.  If the process comes back to the same CPU
+// with the registers untouched by anybody else (cpu->fpuowner
+// and p->fpucpu agree), fputrap only has to clear TS.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+
+#define CPUID_FXSR 0x01000000  // cpuid(1) %edx: fxsave/fxrstor
+#define CPUID_SSE  0x02000000  // cpuid(1) %edx: SSE
+
+// Register contents a process starts out with.
+static uchar fpuinitstate[512] __attribute__((aligned(16)));
+
+// Enable the FPU and SSE on this CPU, with TS set so that the
+// first use traps.
+void
+fpuinit(void)
+{
+  uint edx, mxcsr;
+
+  cpuid(1, 0, 0, 0, &edx);
+  if((edx & (CPUID_FXSR|CPUID_SSE)) != (CPUID_FXSR|CPUID_SSE))
+    panic("fpuinit: no SSE");
+  lcr4(rcr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+  lcr0((rcr0() & ~(CR0_EM|CR0_TS)) | CR0_MP | CR0_NE);
+  if(cpunum() == mpbcpu()){
+    mxcsr = 0x1f80;  // all SIMD exceptions masked
+    asm volatile("fninit; ldmxcsr %0" : : "m" (mxcsr));
+    fxsave(fpuinitstate);
+  }
+  cpu->fpuowner = 0;
+  lcr0(rcr0() | CR0_TS);
+}
+
+// Device-not-available trap: the current process wants the FPU.
+void
+fputrap(void)
+{
+  clts();
+  if(cpu->fpuowner != proc || proc->fpucpu != cpu)
+    fxrstor(proc->usedfpu ? proc->fxstate : fpuinitstate);
+  cpu->fpuowner = proc;
+  proc->fpucpu = cpu;
+  proc->usedfpu = 1;
+}
+
+// Process p has stopped running on this CPU.  If it used the
+// FPU, save the registers, and set TS for the next process.
+void
+fpuswitchout(struct proc *p)
+{
+  if((rcr0() & CR0_TS) == 0){
+    fxsave(p->fxstate);
+    lcr0(rcr0() | CR0_TS);
+  }
+}
+
+// Give np the current process's FPU state, for fork and clone.
+void
+fpucopy(struct proc *np)
+{
+  pushcli();
+  if((rcr0() & CR0_TS) == 0)
+    fxsave(proc->fxstate);
+  popcli();
+  np->usedfpu = proc->usedfpu;
+  memmove(np->fxstate, proc->fxstate, sizeof(np->fxstate));
+}
+
+// The current process is starting a new program: forget its
+// FPU state.
+void
+fpureset(void)
+{
+  pushcli();
+  proc->usedfpu = 0;
+  proc->fpucpu = 0;
+  lcr0(rcr0() | CR0_TS);
+  popcli();
+}
@@ -20,10 +20,25 @@
 #include "buf.h"
 #include "fs.h"
 #include "file.h"
+#include "pcache.h"
+#include "sysinfo.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
 
+uint rootdev = ROOTDEV;  // disk holding the root file system
+
+// Mounted file systems.  The root directory of disk m[i].dev
+// stands in for directory m[i].ip, which the table holds a
+// reference to; namex crosses between them both ways.
+struct {
+  struct spinlock lock;
+  struct {
+    struct inode *ip;
+    uint dev;
+  } m[NMOUNT];
+} mtable;
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -35,64 +50,300 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
-// Zero a block.
+// File systems in use.
+//
+// Each disk with a file system in use has a struct fs, loaded
+// by fsget when the file system is mounted, or the first time
+// the root disk is asked for: a copy of its superblock, a copy
+// of its free block bitmap, the number of free blocks under
+// each bitmap block, and a map of which inodes are free, built
+// from the inode blocks.  balloc searches the copy, skipping
+// bitmap blocks with nothing free, instead of reading the
+// bitmap from block 0 on, and ialloc finds a free inode without
+// reading any; the disk is still kept up to date through the
+// buffer cache.  fs->lock guards the copies.
+
+#define NFS (NMOUNT+1)  // the root and the mounted file systems
+#define FSMAXBB 64      // most bitmap blocks a file system may have
+
+// The byte of the bitmap copy holding block b's bit.
+#define FSBYTE(fs, b) (&(fs)->bmap[(b) / (PGSIZE*8)][(b) % (PGSIZE*8) / 8])
+
+// Whether inode inum is in use, by fs->imap.
+#define IUSED(fs, inum) ((fs)->imap[(inum) / 8] & (1 << ((inum) % 8)))
+
+struct fs {
+  struct spinlock lock;
+  uint dev;
+  int state;               // 0, FS_LOADING or FS_READY
+  struct superblock sb;
+  uchar *bmap[FSMAXBB * BSIZE / PGSIZE];  // bitmap copy, a page at a time
+  uint nfree[FSMAXBB];     // free blocks under each bitmap block
+  uint nbfree;             // free blocks in all
+  uint bnext;              // where to look for a block with no goal
+  uchar *imap;             // bit set for each inode in use
+  uint nifree;             // free inodes
+};
+
+#define FS_LOADING 1
+#define FS_READY   2
+
+struct {
+  struct spinlock lock;
+  struct fs fs[NFS];
+} fstab;
+
+// Whether sb, read from disk dev, describes a file system that
+// fits on dev and in the copies fsload makes of its bitmap and
+// inode map.
+static int
+sbvalid(uint dev, struct superblock *sb)
+{
+  if(sb->size == 0 || sb->ninodes == 0 || sb->nblocks > sb->size)
+    return 0;
+  if(sb->size > bdevsw[dev].nsect / (BSIZE/512))
+    return 0;
+  if((sb->size + BPB - 1) / BPB > FSMAXBB || sb->ninodes > PGSIZE*8)
+    return 0;
+  if(BBLOCK(sb->size - 1, sb->ninodes) >= sb->size)
+    return 0;
+  return 1;
+}
+
+// Free the copies fsload made in fs.
 static void
-bzero(int dev, int bno)
+fsunload(struct fs *fs)
+{
+  int i;
+
+  for(i = 0; i < NELEM(fs->bmap); i++){
+    if(fs->bmap[i])
+      kfree((char*)fs->bmap[i]);
+    fs->bmap[i] = 0;
+  }
+  if(fs->imap)
+    kfree((char*)fs->imap);
+  fs->imap = 0;
+}
+
+// Read the superblock and bitmap of fs->dev into fs.  Returns
+// 0, or -1 if the superblock is bad or memory runs out.
+static int
+fsload(struct fs *fs)
 {
   struct buf *bp;
-  
-  bp = bread(dev, bno);
-  memset(bp->data, 0, BSIZE);
-  bwrite(bp);
-  brelse(bp);
+  struct dinode *dip;
+  uint b, bi, n, inum;
+  int i;
+
+  memset(fs->nfree, 0, sizeof(fs->nfree));
+  fs->nbfree = 0;
+  fs->bnext = 0;
+  fs->nifree = 0;
+  readsb(fs->dev, &fs->sb);
+  if(!sbvalid(fs->dev, &fs->sb))
+    return -1;
+  for(i = 0; i * PGSIZE * 8 < fs->sb.size; i++)
+    if((fs->bmap[i] = (uchar*)kalloc()) == 0)
+      goto bad;
+  for(b = 0; b < fs->sb.size; b += BPB){
+    bp = bread(fs->dev, BBLOCK(b, fs->sb.ninodes));
+    memmove(FSBYTE(fs, b), bp->data, BSIZE);
+    brelse(bp);
+    n = 0;
+    for(bi = 0; bi < BPB && b + bi < fs->sb.size; bi++)
+      if((*FSBYTE(fs, b + bi) & (1 << (bi % 8))) == 0)
+        n++;
+    fs->nfree[b / BPB] = n;
+    fs->nbfree += n;
+  }
+
+  if((fs->imap = (uchar*)kalloc()) == 0)
+    goto bad;
+  memset(fs->imap, 0, PGSIZE);
+  fs->imap[0] = 1;  // there is no inode 0
+  for(inum = 1; inum < fs->sb.ninodes; inum++){
+    if(inum == 1 || inum % IPB == 0){
+      if(inum > 1)
+        brelse(bp);
+      bp = bread(fs->dev, IBLOCK(inum));
+    }
+    dip = (struct dinode*)bp->data + inum%IPB;
+    if(dip->type != 0)
+      fs->imap[inum / 8] |= 1 << (inum % 8);
+    else
+      fs->nifree++;
+  }
+  if(fs->sb.ninodes > 1)
+    brelse(bp);
+  return 0;
+
+bad:
+  fsunload(fs);
+  return -1;
+}
+
+// Return the in-memory state of the file system on dev,
+// loading it if nobody has yet, or 0 if it can't be loaded.
+static struct fs*
+fsopen(uint dev)
+{
+  struct fs *fs, *empty;
+  int r;
+
+  acquire(&fstab.lock);
+  empty = 0;
+  for(fs = fstab.fs; fs < &fstab.fs[NFS]; fs++){
+    if(fs->state && fs->dev == dev){
+      while(fs->state == FS_LOADING)
+        sleep(fs, &fstab.lock);
+      if(fs->state != FS_READY)
+        fs = 0;  // the load failed
+      release(&fstab.lock);
+      return fs;
+    }
+    if(empty == 0 && fs->state == 0)
+      empty = fs;
+  }
+  if(empty == 0){
+    release(&fstab.lock);
+    return 0;
+  }
+  fs = empty;
+  fs->dev = dev;
+  fs->state = FS_LOADING;
+  release(&fstab.lock);
+
+  initlock(&fs->lock, "fs");
+  r = fsload(fs);
+
+  acquire(&fstab.lock);
+  fs->state = r < 0 ? 0 : FS_READY;
+  wakeup(fs);
+  release(&fstab.lock);
+  return r < 0 ? 0 : fs;
+}
+
+// fsopen for the root and mounted file systems, which mount
+// has already loaded.
+static struct fs*
+fsget(uint dev)
+{
+  struct fs *fs;
+
+  if((fs = fsopen(dev)) == 0)
+    panic("fsget: bad file system");
+  return fs;
 }
 
 // Blocks. 
 
-// Allocate a disk block.
+// Return the first free block in [from, to) of fs's bitmap
+// copy, or to if there is none.  Caller holds fs->lock.
 static uint
-balloc(uint dev)
+bscan(struct fs *fs, uint from, uint to)
 {
-  int b, bi, m;
-  struct buf *bp;
-  struct superblock sb;
+  uint b;
 
-  bp = 0;
-  readsb(dev, &sb);
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb.ninodes));
-    for(bi = 0; bi < BPB; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use on disk.
-        bwrite(bp);
-        brelse(bp);
-        return b + bi;
-      }
+  for(b = from; b < to; b++){
+    if(b % 8 == 0 && b + 8 <= to && *FSBYTE(fs, b) == 0xff){
+      b += 7;
+      continue;
     }
-    brelse(bp);
+    if((*FSBYTE(fs, b) & (1 << (b % 8))) == 0)
+      break;
   }
-  panic("balloc: out of blocks");
+  return b;
 }
 
-// Free a disk block.
+// Allocate a disk block: the first free one at or after goal
+// under goal's bitmap block, else the first one after that,
+// going round the disk.  Goal 0 means anywhere; allocation then
+// carries on from where the last one left off.
+static uint
+balloc(uint dev, uint goal)
+{
+  struct fs *fs;
+  struct buf *bp;
+  uint b, bb, end, nbb, i;
+
+  fs = fsget(dev);
+  acquire(&fs->lock);
+  while(fs->nbfree == 0){
+    // Unlinked files may be about to give some back.
+    release(&fs->lock);
+    if(ireclaimwait() < 0)
+      panic("balloc: out of blocks");
+    acquire(&fs->lock);
+  }
+  if(goal == 0 || goal >= fs->sb.size)
+    goal = fs->bnext;
+  nbb = (fs->sb.size + BPB - 1) / BPB;
+  end = min(fs->sb.size, goal - goal % BPB + BPB);
+  b = bscan(fs, goal, end);
+  for(i = 1; b == end && i <= nbb; i++){
+    bb = (goal / BPB + i) % nbb;
+    if(fs->nfree[bb] == 0)
+      continue;
+    end = min(fs->sb.size, bb*BPB + BPB);
+    b = bscan(fs, bb*BPB, end);
+  }
+  if(b == end)
+    panic("balloc: free count wrong");
+  *FSBYTE(fs, b) |= 1 << (b % 8);
+  fs->nfree[b / BPB]--;
+  fs->nbfree--;
+  fs->bnext = b + 1 < fs->sb.size ? b + 1 : 0;
+  release(&fs->lock);
+
+  bp = bread(dev, BBLOCK(b, fs->sb.ninodes));
+  bp->data[b % BPB / 8] |= 1 << (b % 8);  // Mark block in use on disk.
+  bwrite(bp);
+  brelse(bp);
+  return b;
+}
+
+// Allocate a disk block as balloc does and zero it.  The zeros
+// go to the buffer cache and reach the disk with the delayed
+// writes, ahead of any read of the block.
+static uint
+bnew(uint dev, uint goal)
+{
+  struct buf *bp;
+  uint b;
+
+  b = balloc(dev, goal);
+  bp = bzero(dev, b);
+  bwrite(bp);
+  brelse(bp);
+  return b;
+}
+
+// Free a disk block.  Its contents stay on the disk, not to be
+// trusted: bmap zeroes every block it allocates.
 static void
 bfree(int dev, uint b)
 {
+  struct fs *fs;
   struct buf *bp;
-  struct superblock sb;
   int bi, m;
 
-  bzero(dev, b);
-
-  readsb(dev, &sb);
-  bp = bread(dev, BBLOCK(b, sb.ninodes));
+  fs = fsget(dev);
+  bp = bread(dev, BBLOCK(b, fs->sb.ninodes));
   bi = b % BPB;
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;  // Mark block free on disk.
   bwrite(bp);
+  // Free it in the copy only now, while we hold the bitmap
+  // block: balloc can't mark it in use on disk before we have
+  // marked it free.
+  acquire(&fs->lock);
+  *FSBYTE(fs, b) &= ~m;
+  fs->nfree[b / BPB]++;
+  fs->nbfree++;
+  release(&fs->lock);
   brelse(bp);
 }
 
@@ -110,7 +361,7 @@ bfree(int dev, uint b)
 // 
 // ip->ref counts the number of pointer references to this cached
 // inode; references are typically kept in struct file and in proc->cwd.
-// When ip->ref falls to zero, the inode is no longer cached.
+// When ip->ref falls to zero, the inode may be reused for another.
 // It is an error to use an inode without holding a reference to it.
 //
 // Processes are only allowed to read and write inode
@@ -128,43 +379,125 @@ bfree(int dev, uint b)
 // return pointers to *unlocked* inodes.  It is the callers'
 // responsibility to lock them before using them.  A non-zero
 // ip->ref keeps these unlocked inodes in the cache.
+//
+// When the last reference to an inode with no links goes, iput
+// hands the inode, locked and with that reference, to the
+// kernel thread ireclaimd, which frees its blocks and the inode
+// itself.  So unlink returns without waiting for a large file
+// to be truncated.
+//
+// In-core inodes are found by (dev, inum) through a hash
+// table.  One nobody holds stays in the cache, still valid, on
+// an LRU list, so that opening or stat'ing a file again needn't
+// read its inode from disk.  The cache takes memory a page at a
+// time, up to NINODE inodes; after that, or when memory is
+// short, iget reuses the least recently used unheld inode.
+
+#define NIHASH 61
+#define IHASH(dev, inum) (((dev)*31 + (inum)) % NIHASH)
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *hash[NIHASH];  // through hnext
+  struct inode *free;     // never used, through hnext
+  int ninode;             // in-core inodes, used or not
+
+  // Linked list of unheld inodes, through lprev/lnext.
+  // lru.lnext is most recently used.
+  struct inode lru;
+
+  struct inode *reclaim;  // waiting for ireclaimd, through rnext
+  int nreclaim;           // given to ireclaimd and not yet freed
+  uint nread;             // inodes ilock read from disk
 } icache;
 
 void
 iinit(void)
 {
   initlock(&icache.lock, "icache");
+  icache.lru.lprev = &icache.lru;
+  icache.lru.lnext = &icache.lru;
+  initlock(&fstab.lock, "fstab");
+  initlock(&mtable.lock, "mtable");
 }
 
 static struct inode* iget(uint dev, uint inum);
 
-// Allocate a new inode with the given type on device dev.
+// Report the size and free space of the root file system, and
+// inode cache statistics, for the sysinfo system call.
+void
+fsstat(struct sysinfo *si)
+{
+  struct fs *fs;
+
+  fs = fsget(rootdev);
+  acquire(&fs->lock);
+  si->fsblocks = fs->sb.size;
+  si->fsfree = fs->nbfree;
+  release(&fs->lock);
+
+  acquire(&icache.lock);
+  si->ninode = icache.ninode;
+  si->niread = icache.nread;
+  release(&icache.lock);
+}
+
+// Allocate a new inode with the given type on device dev,
+// in the same inode block as inode near if one there is free,
+// else in the first block after it that has one.
 struct inode*
-ialloc(uint dev, short type)
+ialloc(uint dev, short type, uint near)
 {
-  int inum;
+  struct fs *fs;
+  uint inum, i;
   struct buf *bp;
   struct dinode *dip;
-  struct superblock sb;
 
-  readsb(dev, &sb);
-  for(inum = 1; inum < sb.ninodes; inum++){  // loop over inode blocks
-    bp = bread(dev, IBLOCK(inum));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      bwrite(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
-    }
-    brelse(bp);
+  fs = fsget(dev);
+  acquire(&fs->lock);
+  while(fs->nifree == 0){
+    release(&fs->lock);
+    if(ireclaimwait() < 0)
+      panic("ialloc: no inodes");
+    acquire(&fs->lock);
+  }
+  if(near >= fs->sb.ninodes)
+    near = 0;
+  inum = near - near%IPB;
+  for(i = 0; i < fs->sb.ninodes; i++){
+    if(!IUSED(fs, inum))
+      break;
+    if(++inum == fs->sb.ninodes)
+      inum = 0;
   }
-  panic("ialloc: no inodes");
+  fs->imap[inum / 8] |= 1 << (inum % 8);
+  fs->nifree--;
+  release(&fs->lock);
+
+  bp = bread(dev, IBLOCK(inum));
+  dip = (struct dinode*)bp->data + inum%IPB;
+  if(dip->type != 0)
+    panic("ialloc: inode in use");
+  memset(dip, 0, sizeof(*dip));
+  dip->type = type;
+  bwrite(bp);   // mark it allocated on the disk
+  brelse(bp);
+  return iget(dev, inum);
+}
+
+// Inode inum on dev is free again on disk.
+static void
+ifree(uint dev, uint inum)
+{
+  struct fs *fs;
+
+  fs = fsget(dev);
+  acquire(&fs->lock);
+  if(!IUSED(fs, inum))
+    panic("ifree: inode not in use");
+  fs->imap[inum / 8] &= ~(1 << (inum % 8));
+  fs->nifree++;
+  release(&fs->lock);
 }
 
 // Copy inode, which has changed, from memory to disk.
@@ -186,36 +519,95 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+// Put ip, which nobody holds any more, on the LRU list: at the
+// front if it is still valid, else at the back, to be reused
+// first.  Caller holds icache.lock.
+static void
+lruadd(struct inode *ip)
+{
+  struct inode *at;
+
+  at = (ip->flags & I_VALID) ? &icache.lru : icache.lru.lprev;
+  ip->lnext = at->lnext;
+  ip->lprev = at;
+  at->lnext->lprev = ip;
+  at->lnext = ip;
+}
+
+// Take ip off the LRU list.  Caller holds icache.lock.
+static void
+lruremove(struct inode *ip)
+{
+  ip->lprev->lnext = ip->lnext;
+  ip->lnext->lprev = ip->lprev;
+}
+
+// Find an in-core inode to use for another: a fresh one, out
+// of a new page if the cache may grow, else the least recently
+// used one nobody holds.  Returns 0 if there is none.  Caller
+// holds icache.lock.
+static struct inode*
+inew(void)
+{
+  struct inode *ip, **pp;
+  char *page;
+  int i;
+
+  if(icache.free == 0 && icache.ninode < NINODE &&
+     (page = kalloc_zeroed()) != 0){
+    ip = (struct inode*)page;
+    for(i = 0; i < PGSIZE / sizeof(*ip); i++, ip++){
+      ip->hnext = icache.free;
+      icache.free = ip;
+    }
+    icache.ninode += PGSIZE / sizeof(*ip);
+  }
+  if((ip = icache.free) != 0){
+    icache.free = ip->hnext;
+    return ip;
+  }
+
+  ip = icache.lru.lprev;
+  if(ip == &icache.lru)
+    return 0;
+  lruremove(ip);
+  for(pp = &icache.hash[IHASH(ip->dev, ip->inum)]; *pp != ip;
+      pp = &(*pp)->hnext)
+    ;
+  *pp = ip->hnext;
+  return ip;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
 
   acquire(&icache.lock);
 
   // Try for cached inode.
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = icache.hash[IHASH(dev, inum)]; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        lruremove(ip);
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
   // Allocate fresh inode.
-  if(empty == 0)
+  if((ip = inew()) == 0)
     panic("iget: no inodes");
 
-  ip = empty;
+  pcdrop(ip);  // pages of the slot's previous inode
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->flags = 0;
+  ip->hnext = icache.hash[IHASH(dev, inum)];
+  icache.hash[IHASH(dev, inum)] = ip;
   release(&icache.lock);
 
   return ip;
@@ -246,6 +638,8 @@ ilock(struct inode *ip)
   while(ip->flags & I_BUSY)
     sleep(ip, &icache.lock);
   ip->flags |= I_BUSY;
+  if(!(ip->flags & I_VALID))
+    icache.nread++;
   release(&icache.lock);
 
   if(!(ip->flags & I_VALID)){
@@ -283,20 +677,69 @@ iput(struct inode *ip)
 {
   acquire(&icache.lock);
   if(ip->ref == 1 && (ip->flags & I_VALID) && ip->nlink == 0){
-    // inode is no longer used: truncate and free inode.
+    // inode is no longer used: ireclaimd will truncate and free
+    // it, and drop this reference.
     if(ip->flags & I_BUSY)
       panic("iput busy");
     ip->flags |= I_BUSY;
+    ip->rnext = icache.reclaim;
+    icache.reclaim = ip;
+    icache.nreclaim++;
+    wakeup(&icache.reclaim);
     release(&icache.lock);
+    return;
+  }
+  if(--ip->ref == 0)
+    lruadd(ip);
+  release(&icache.lock);
+}
+
+// The reclaimer, a kernel thread.  Truncates and frees the
+// inodes iput gives it.
+void
+ireclaimd(void)
+{
+  struct inode *ip;
+
+  acquire(&icache.lock);
+  for(;;){
+    while(icache.reclaim == 0)
+      sleep(&icache.reclaim, &icache.lock);
+    ip = icache.reclaim;
+    icache.reclaim = ip->rnext;
+    release(&icache.lock);
+
+    if(ip->type == T_DIR)
+      dcpurge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
+    ifree(ip->dev, ip->inum);
+
     acquire(&icache.lock);
     ip->flags = 0;
     wakeup(ip);
+    if(--ip->ref == 0)
+      lruadd(ip);
+    if(--icache.nreclaim == 0)
+      wakeup(&icache.nreclaim);
+  }
+}
+
+// Wait until ireclaimd has freed every inode given to it so
+// far.  Returns -1 at once if there are none.
+int
+ireclaimwait(void)
+{
+  acquire(&icache.lock);
+  if(icache.nreclaim == 0){
+    release(&icache.lock);
+    return -1;
   }
-  ip->ref--;
+  while(icache.nreclaim > 0)
+    sleep(&icache.nreclaim, &icache.lock);
   release(&icache.lock);
+  return 0;
 }
 
 // Common idiom: unlock, then put.
@@ -319,24 +762,32 @@ iunlockput(struct inode *ip)
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
+  uint addr, goal, *a;
   struct buf *bp;
 
+  // New blocks go right after the block before them, if it
+  // is free, to keep the file in one piece on disk.
   if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[bn]) == 0){
+      goal = bn > 0 && ip->addrs[bn-1] ? ip->addrs[bn-1] + 1 : 0;
+      ip->addrs[bn] = addr = bnew(ip->dev, goal);
+    }
     return addr;
   }
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
+    if((addr = ip->addrs[NDIRECT]) == 0){
+      goal = ip->addrs[NDIRECT-1] ? ip->addrs[NDIRECT-1] + 1 : 0;
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev, goal);
+      bp = bzero(ip->dev, addr);
+    } else
+      bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      goal = bn > 0 && a[bn-1] ? a[bn-1] + 1 : ip->addrs[NDIRECT] + 1;
+      a[bn] = addr = bnew(ip->dev, goal);
       bwrite(bp);
     }
     brelse(bp);
@@ -377,6 +828,37 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  pcdrop(ip);
+}
+
+// Write ip's data blocks, its inode and the free block bitmap
+// to disk.  Caller holds ip's lock.
+void
+isync(struct inode *ip)
+{
+  struct fs *fs;
+  struct buf *bp;
+  uint a[NINDIRECT], b;
+  int i;
+
+  for(i = 0; i < NDIRECT; i++)
+    if(ip->addrs[i])
+      bsyncblock(ip->dev, ip->addrs[i]);
+  if(ip->addrs[NDIRECT]){
+    // Copy the block numbers out rather than hold the indirect
+    // block while waiting for the others.
+    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+    memmove(a, bp->data, sizeof(a));
+    brelse(bp);
+    for(i = 0; i < NINDIRECT; i++)
+      if(a[i])
+        bsyncblock(ip->dev, a[i]);
+    bsyncblock(ip->dev, ip->addrs[NDIRECT]);
+  }
+  bsyncblock(ip->dev, IBLOCK(ip->inum));
+  fs = fsget(ip->dev);
+  for(b = 0; b < fs->sb.size; b += BPB)
+    bsyncblock(ip->dev, BBLOCK(b, fs->sb.ninodes));
 }
 
 // Copy stat information from inode.
@@ -390,12 +872,74 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
-// Read data from inode.
+// Read the page of ip's contents at offset off into page,
+// filling the part past the end of the file with zeros.
+// Caller holds ip's lock.
+void
+ireadpage(struct inode *ip, uint off, char *page)
+{
+  uint n, m, len;
+  struct buf *bp;
+
+  len = off < ip->size ? min(PGSIZE, ip->size - off) : 0;
+  for(n = 0; n < len; n += m){
+    bp = bread(ip->dev, bmap(ip, (off+n)/BSIZE));
+    m = min(len - n, BSIZE);
+    memmove(page + n, bp->data, m);
+    bp->flags |= B_COLD;
+    brelse(bp);
+  }
+  memset(page + len, 0, PGSIZE - len);
+}
+
+// Write the page at offset off of ip, as far as the end of
+// the file, from page back to disk.  Caller holds ip's lock.
+void
+iwritepage(struct inode *ip, uint off, char *page)
+{
+  uint n, m, len;
+  struct buf *bp;
+
+  len = off < ip->size ? min(PGSIZE, ip->size - off) : 0;
+  for(n = 0; n < len; n += m){
+    bp = bread(ip->dev, bmap(ip, (off+n)/BSIZE));
+    m = min(len - n, BSIZE);
+    memmove(bp->data, page + n, m);
+    bwrite(bp);
+    bp->flags |= B_COLD;
+    brelse(bp);
+  }
+}
+
+// Start reading blocks from up to to of ip into the buffer
+// cache, leaving out those past the end of the file and those
+// whose page is in the page cache.  Caller holds ip's lock.
+void
+ireadahead(struct inode *ip, uint from, uint to)
+{
+  struct pcpage *pg;
+  uint bn;
+
+  if(ip->type == T_DEV)
+    return;
+  to = min(to, (ip->size + BSIZE - 1) / BSIZE);
+  for(bn = from; bn < to; bn++){
+    if((pg = pclookup(ip, bn*BSIZE)) != 0){
+      pcput(pg);
+      bn |= PGSIZE/BSIZE - 1;  // skip to the page's last block
+      continue;
+    }
+    breadahead(ip->dev, bmap(ip, bn));
+  }
+}
+
+// Read data from inode, through the page cache.
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  struct pcpage *pg;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
@@ -409,6 +953,13 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    if((pg = pcget(ip, off)) != 0){
+      m = min(n - tot, PGSIZE - off%PGSIZE);
+      memmove(dst, pg->data + off%PGSIZE, m);
+      pcput(pg);
+      continue;
+    }
+    // Page cache full: read the block directly.
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(dst, bp->data + off%BSIZE, m);
@@ -417,12 +968,13 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   return n;
 }
 
-// Write data to inode.
+// Write data to inode, and to its cached pages.
 int
 writei(struct inode *ip, char *src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  struct pcpage *pg;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].write)
@@ -440,6 +992,11 @@ writei(struct inode *ip, char *src, uint off, uint n)
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
     bwrite(bp);
+    if((pg = pclookup(ip, off)) != 0){
+      bp->flags |= B_COLD;
+      memmove(pg->data + off%PGSIZE, src, m);
+      pcput(pg);
+    }
     brelse(bp);
   }
 
@@ -458,33 +1015,28 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
-// Look for a directory entry in a directory.
-// If found, set *poff to byte offset of entry.
-// Caller must have already locked dp.
-struct inode*
-dirlookup(struct inode *dp, char *name, uint *poff)
+// Look for name in the directory dp, one block after another.
+// Returns its inode number and sets *poff, or returns 0.
+static uint
+dirscan(struct inode *dp, char *name, uint *poff)
 {
   uint off, inum;
   struct buf *bp;
   struct dirent *de;
 
-  if(dp->type != T_DIR)
-    panic("dirlookup not DIR");
-
   for(off = 0; off < dp->size; off += BSIZE){
     bp = bread(dp->dev, bmap(dp, off / BSIZE));
     for(de = (struct dirent*)bp->data;
-        de < (struct dirent*)(bp->data + BSIZE);
+        de < (struct dirent*)(bp->data + min(BSIZE, dp->size - off));
         de++){
       if(de->inum == 0)
         continue;
       if(namecmp(name, de->name) == 0){
         // entry matches path element
-        if(poff)
-          *poff = off + (uchar*)de - bp->data;
+        *poff = off + (uchar*)de - bp->data;
         inum = de->inum;
         brelse(bp);
-        return iget(dp->dev, inum);
+        return inum;
       }
     }
     brelse(bp);
@@ -492,6 +1044,218 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   return 0;
 }
 
+// Hashed directories.
+
+// Hash of a directory entry name; a hashed directory uses its
+// low bits.  tools/mkfs.c has a copy.
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  // Mix, so that the low bits depend on every character.
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return h;
+}
+
+// Read the header of hashed directory dp out of the name
+// fields of block 0.
+static void
+dirhread(struct inode *dp, struct dirhhdr *hd)
+{
+  struct buf *bp;
+  struct dirent *de;
+  uchar *p, *end;
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  de = (struct dirent*)bp->data;
+  end = (uchar*)(hd + 1);
+  for(p = (uchar*)hd; p < end; p += DIRSIZ, de++)
+    memmove(p, de->name, min(DIRSIZ, end - p));
+  brelse(bp);
+}
+
+// Write hd back to block 0 of hashed directory dp.
+static void
+dirhwrite(struct inode *dp, struct dirhhdr *hd)
+{
+  struct dirent de;
+  uchar *p, *end;
+  uint off;
+
+  end = (uchar*)(hd + 1);
+  for(p = (uchar*)hd, off = 0; p < end; p += DIRSIZ, off += sizeof(de)){
+    memset(&de, 0, sizeof(de));
+    memmove(de.name, p, min(DIRSIZ, end - p));
+    if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+      panic("dirhwrite");
+  }
+}
+
+// The block of hashed directory dp that name belongs in.
+static uint
+dirhblock(struct inode *dp, char *name)
+{
+  struct dirhhdr hd;
+
+  dirhread(dp, &hd);
+  return hd.table[dirhash(name) & ((1 << hd.depth) - 1)];
+}
+
+// Look for name in the hashed directory dp: only in the block
+// it belongs in.  Returns its inode number and sets *poff, or
+// returns 0.
+static uint
+dirhscan(struct inode *dp, char *name, uint *poff)
+{
+  uint b, inum;
+  struct buf *bp;
+  struct dirent *de;
+
+  b = dirhblock(dp, name);
+  bp = bread(dp->dev, bmap(dp, b));
+  for(de = (struct dirent*)bp->data;
+      de < (struct dirent*)(bp->data + BSIZE);
+      de++){
+    if(de->inum != 0 && namecmp(name, de->name) == 0){
+      *poff = b*BSIZE + (uchar*)de - bp->data;
+      inum = de->inum;
+      brelse(bp);
+      return inum;
+    }
+  }
+  brelse(bp);
+  return 0;
+}
+
+// Split the full block b of hashed directory dp in two: the
+// entries whose next hash bit is 1 move to a new block at the
+// end, doubling the table if b's entries already share all
+// the bits it uses.  Returns -1 if b can't be split, because
+// the directory is as large as a file can be or the table as
+// large as the header holds.
+static int
+dirhsplit(struct inode *dp, struct dirhhdr *hd, uint b)
+{
+  static char zero[BSIZE];
+  struct buf *bp;
+  struct dirent de;
+  uint ld, nb, i, off, dst;
+
+  ld = hd->ldepth[b];
+  nb = dp->size / BSIZE;
+  if(ld == DIRHDEPTH || nb == MAXFILE)
+    return -1;
+  if(ld == hd->depth){
+    for(i = 0; i < (1 << hd->depth); i++)
+      hd->table[i + (1 << hd->depth)] = hd->table[i];
+    hd->depth++;
+  }
+  if(writei(dp, zero, nb*BSIZE, BSIZE) != BSIZE)
+    panic("dirhsplit");
+  hd->ldepth[b] = hd->ldepth[nb] = ld + 1;
+  for(i = 0; i < (1 << hd->depth); i++)
+    if(hd->table[i] == b && ((i >> ld) & 1))
+      hd->table[i] = nb;
+
+  dst = nb*BSIZE;
+  for(off = b*BSIZE; off < (b+1)*BSIZE; off += sizeof(de)){
+    bp = bread(dp->dev, bmap(dp, b));
+    memmove(&de, bp->data + off%BSIZE, sizeof(de));
+    brelse(bp);
+    if(de.inum == 0 || ((dirhash(de.name) >> ld) & 1) == 0)
+      continue;
+    if(writei(dp, (char*)&de, dst, sizeof(de)) != sizeof(de))
+      panic("dirhsplit");
+    dcenter(dp->dev, dp->inum, de.name, de.inum, dst);
+    dst += sizeof(de);
+    memset(&de, 0, sizeof(de));
+    if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+      panic("dirhsplit");
+  }
+  dirhwrite(dp, hd);
+  return 0;
+}
+
+// Find a free slot for name in the hashed directory dp,
+// splitting its block while that is full.  Returns the slot's
+// offset, or -1 if the directory can't take name.
+static int
+dirhslot(struct inode *dp, char *name)
+{
+  struct dirhhdr hd;
+  struct buf *bp;
+  struct dirent *de;
+  uint b;
+  int off;
+
+  for(;;){
+    dirhread(dp, &hd);
+    b = hd.table[dirhash(name) & ((1 << hd.depth) - 1)];
+    bp = bread(dp->dev, bmap(dp, b));
+    for(de = (struct dirent*)bp->data;
+        de < (struct dirent*)(bp->data + BSIZE);
+        de++){
+      if(de->inum == 0){
+        off = b*BSIZE + (uchar*)de - bp->data;
+        brelse(bp);
+        return off;
+      }
+    }
+    brelse(bp);
+    if(dirhsplit(dp, &hd, b) < 0)
+      return -1;
+  }
+}
+
+// Make the new, empty directory dp a hashed one: a header and
+// one empty block that every name belongs in.  Caller holds
+// dp's lock.
+void
+dirhinit(struct inode *dp)
+{
+  static char zero[BSIZE];
+  struct dirhhdr hd;
+
+  dp->major = DIR_HASHED;
+  memset(&hd, 0, sizeof(hd));
+  hd.table[0] = 1;
+  dirhwrite(dp, &hd);
+  if(writei(dp, zero, BSIZE, BSIZE) != BSIZE)
+    panic("dirhinit");
+}
+
+// Look for a directory entry in a directory.
+// If found, set *poff to byte offset of entry.
+// Caller must have already locked dp.
+struct inode*
+dirlookup(struct inode *dp, char *name, uint *poff)
+{
+  uint off, inum;
+
+  if(dp->type != T_DIR)
+    panic("dirlookup not DIR");
+
+  if(dclookup(dp->dev, dp->inum, name, &inum, &off) < 0){
+    if(dp->major == DIR_HASHED)
+      inum = dirhscan(dp, name, &off);
+    else
+      inum = dirscan(dp, name, &off);
+    dcenter(dp->dev, dp->inum, name, inum, inum ? off : 0);
+  }
+  if(inum == 0)
+    return 0;
+  if(poff)
+    *poff = off;
+  return iget(dp->dev, inum);
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
@@ -506,18 +1270,25 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  if(dp->major == DIR_HASHED){
+    if((off = dirhslot(dp, name)) < 0)
+      return -1;
+  } else {
+    // Look for an empty dirent.
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
   }
 
+  memset(&de, 0, sizeof(de));
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcenter(dp->dev, dp->inum, name, inum, off);
   
   return 0;
 }
@@ -561,6 +1332,89 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// Make the root directory of the file system on disk dev appear
+// in place of directory ip.  The mount table keeps the caller's
+// reference to ip.  Returns 0, or -1 if ip is not a directory,
+// dev holds no file system, or either is in use already.
+int
+mount(struct inode *ip, uint dev)
+{
+  int i, slot;
+
+  if(dev >= NBDEV || bdevsw[dev].rw == 0 || dev == rootdev)
+    return -1;
+  ilock(ip);
+  if(ip->type != T_DIR){
+    iunlock(ip);
+    return -1;
+  }
+  iunlock(ip);
+  // Load dev's bitmap and inode map now, to check its superblock.
+  if(fsopen(dev) == 0)
+    return -1;
+
+  acquire(&mtable.lock);
+  slot = -1;
+  for(i = 0; i < NMOUNT; i++){
+    if(mtable.m[i].ip == 0){
+      if(slot < 0)
+        slot = i;
+    } else if(mtable.m[i].ip == ip || mtable.m[i].dev == dev)
+      slot = NMOUNT;
+  }
+  if(slot < 0 || slot == NMOUNT){
+    release(&mtable.lock);
+    return -1;
+  }
+  mtable.m[slot].ip = ip;
+  mtable.m[slot].dev = dev;
+  release(&mtable.lock);
+  return 0;
+}
+
+// If ip has a file system mounted on it, return that file
+// system's root instead.  Consumes the reference to ip.
+static struct inode*
+mountdown(struct inode *ip)
+{
+  int i;
+
+  acquire(&mtable.lock);
+  for(i = 0; i < NMOUNT; i++){
+    if(mtable.m[i].ip == ip){
+      release(&mtable.lock);
+      iput(ip);
+      return iget(mtable.m[i].dev, ROOTINO);
+    }
+  }
+  release(&mtable.lock);
+  return ip;
+}
+
+// If ip is the root of a mounted file system, return the
+// directory it is mounted on instead.  Consumes the reference
+// to ip.
+static struct inode*
+mountup(struct inode *ip)
+{
+  struct inode *mp;
+  int i;
+
+  if(ip->inum != ROOTINO || ip->dev == rootdev)
+    return ip;
+  acquire(&mtable.lock);
+  for(i = 0; i < NMOUNT; i++){
+    if(mtable.m[i].ip && mtable.m[i].dev == ip->dev){
+      mp = idup(mtable.m[i].ip);
+      release(&mtable.lock);
+      iput(ip);
+      return mp;
+    }
+  }
+  release(&mtable.lock);
+  return ip;
+}
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
@@ -570,11 +1424,14 @@ namex(char *path, int nameiparent, char *name)
   struct inode *ip, *next;
 
   if(*path == '/')
-    ip = iget(ROOTDEV, ROOTINO);
+    ip = iget(rootdev, ROOTINO);
   else
     ip = idup(proc->cwd);
 
   while((path = skipelem(path, name)) != 0){
+    // ".." of a mounted root is the parent of its mount point.
+    if(namecmp(name, "..") == 0)
+      ip = mountup(ip);
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
@@ -590,7 +1447,7 @@ namex(char *path, int nameiparent, char *name)
       return 0;
     }
     iunlockput(ip);
-    ip = next;
+    ip = mountdown(next);
   }
   if(nameiparent){
     iput(ip);
@@ -0,0 +1,166 @@
+// Futexes: sleeping on a word of user memory.
+//
+// futexwait(addr, val) sleeps if the word at addr still holds
+// val; futexwake(addr, n) wakes up to n of its sleepers.  User
+// code builds locks on top that only enter the kernel under
+// contention (see user/uthread.c).
+//
+// Sleepers are keyed on the physical address of the word, so
+// processes sharing memory through threads, shm segments or
+// mmap find each other.  Waiters hang off one of NFUTEXHASH
+// buckets by key; each has a struct futexwaiter on its kernel
+// stack and sleeps on it, so a wake touches only its targets.
+//
+// A user page can move while its owner sleeps, when it is paged
+// out and back in.  pageout calls futexevict, which wakes the
+// waiters on the old address; like any futex wake-up this may
+// be spurious, and callers check the word again.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "memlayout.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NFUTEXHASH 64
+
+struct futexwaiter {
+  uint pa;                      // key: physical address of the word
+  int woken;
+  struct futexwaiter *next;
+};
+
+struct futexbucket {
+  struct spinlock lock;
+  struct futexwaiter *head;
+};
+
+static struct futexbucket futexes[NFUTEXHASH];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXHASH; i++)
+    initlock(&futexes[i].lock, "futex");
+}
+
+static struct futexbucket*
+futexbucket(uint pa)
+{
+  return &futexes[((pa >> 2) ^ (pa >> 12)) % NFUTEXHASH];
+}
+
+// Wake up to n waiters on pa from bucket fb, whose lock the
+// caller holds.  Returns the number woken.
+static int
+futexwake1(struct futexbucket *fb, uint pa, int n)
+{
+  struct futexwaiter **wp, *w;
+  int woken;
+
+  woken = 0;
+  for(wp = &fb->head; *wp && woken < n; ){
+    w = *wp;
+    if(w->pa != pa){
+      wp = &w->next;
+      continue;
+    }
+    *wp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    woken++;
+  }
+  return woken;
+}
+
+// Sleep until woken if the word at user address addr of the
+// current process holds val.  Returns 0 when woken, -1 if the
+// word holds something else, addr is bad, or we were killed.
+int
+futexwait(uint addr, uint val)
+{
+  struct futexbucket *fb;
+  struct futexwaiter w, **wp;
+  uint *word;
+
+  if(addr % 4 != 0 || pinuvm((char*)addr, 4) < 0)
+    return -1;
+  if((word = (uint*)uva2ka(proc->pgdir, (char*)addr)) == 0){
+    unpinuvm();
+    return -1;
+  }
+  word += (addr % PGSIZE) / 4;
+  w.pa = V2P(word);
+  w.woken = 0;
+  fb = futexbucket(w.pa);
+  acquire(&fb->lock);
+  if(*word != val){
+    release(&fb->lock);
+    unpinuvm();
+    return -1;
+  }
+  w.next = fb->head;
+  fb->head = &w;
+  // Once queued the page may move; futexevict wakes us if so.
+  unpinuvm();
+  while(!w.woken && !proc->killed)
+    sleep(&w, &fb->lock);
+  if(!w.woken){
+    for(wp = &fb->head; *wp != &w; wp = &(*wp)->next)
+      ;
+    *wp = w.next;
+  }
+  release(&fb->lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake up to n processes waiting on the word at user address
+// addr of the current process.  Returns the number woken.
+int
+futexwake(uint addr, int n)
+{
+  struct futexbucket *fb;
+  char *page;
+  uint pa;
+  int woken;
+
+  if(addr % 4 != 0 || n <= 0)
+    return -1;
+  // A word that is not in memory has no waiters.
+  if((page = uva2ka(proc->pgdir, (char*)addr)) == 0)
+    return 0;
+  pa = V2P(page) + addr % PGSIZE;
+  fb = futexbucket(pa);
+  acquire(&fb->lock);
+  woken = futexwake1(fb, pa, n);
+  release(&fb->lock);
+  return woken;
+}
+
+// The user page at physical address pa is being paged out:
+// wake everybody waiting on a word in it.
+void
+futexevict(uint pa)
+{
+  struct futexbucket *fb;
+  struct futexwaiter **wp, *w;
+
+  for(fb = futexes; fb < &futexes[NFUTEXHASH]; fb++){
+    acquire(&fb->lock);
+    for(wp = &fb->head; *wp; ){
+      w = *wp;
+      if((uint)PGROUNDDOWN(w->pa) != pa){
+        wp = &w->next;
+        continue;
+      }
+      *wp = w->next;
+      w->woken = 1;
+      wakeup(w);
+    }
+    release(&fb->lock);
+  }
+}
@@ -1,154 +1,793 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// IDE driver code, using bus-master DMA if the PCI IDE
+// controller can do it and PIO otherwise.
+//
+// There are two channels, primary and secondary, each with its
+// own ports, interrupt, lock and request queue, and each with up
+// to two drives; disk n is drive n%2 of channel n/2.  A channel
+// runs one command at a time, but the two channels run at once.
+//
+// Requests for consecutive sectors that are queued together go
+// to the disk as one multi-sector command.  With DMA the
+// controller moves the data of the whole command straight into
+// or out of the bufs, described by a PRD table, and interrupts
+// once at the end; the CPU is free meanwhile.  With PIO the CPU
+// copies every word, a block of sectors per interrupt.
+//
+// Requests wait on the channel's pending list until it is free.
+// Which one goes next is up to the I/O scheduler: C-LOOK by
+// default, which sweeps up the disk in sector order and then
+// jumps back to the lowest request, except that a read waiting
+// for more than IDEDEADLINE ticks goes first; or plain FIFO.
+//
+// The driver never spins on the status register once the system
+// is up.  It sends a command only when one status read shows
+// the drive ready, and otherwise leaves it to idetimer, called
+// every tick, to try again.  A command that gets no interrupt
+// for IDETIMEOUT ticks, or ends in an error, resets the channel
+// and goes again, up to IDERETRIES times.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
 #include "buf.h"
+#include "pci.h"
+#include "sysinfo.h"
+
+// Command block registers, from the channel's base port.
+#define IDE_DATA      0
+#define IDE_COUNT     2
+#define IDE_LBA0      3
+#define IDE_LBA1      4
+#define IDE_LBA2      5
+#define IDE_DRIVE     6
+#define IDE_STATUS    7  // reading
+#define IDE_CMD       7  // writing
 
 #define IDE_BSY       0x80
 #define IDE_DRDY      0x40
 #define IDE_DF        0x20
+#define IDE_DRQ       0x08
 #define IDE_ERR       0x01
 
 #define IDE_CMD_READ  0x20
 #define IDE_CMD_WRITE 0x30
+#define IDE_CMD_RDMUL 0xc4
+#define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_IDENTIFY 0xec
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
-// You must hold idelock while manipulating queue.
+// Bus master registers of a channel, from its bm port.
+#define BM_CMD        0
+#define BM_STATUS     2
+#define BM_PRDT       4
 
-static struct spinlock idelock;
-static struct buf *idequeue;
+#define BM_START      0x01  // BM_CMD: go
+#define BM_READ       0x08  // BM_CMD: the controller writes memory
+#define BM_ERR        0x02  // BM_STATUS: transfer failed
+#define BM_INTR       0x04  // BM_STATUS: the drive interrupted
+#define BM_DMACAP     0x60  // BM_STATUS: both drives can do DMA
 
-static int havedisk1;
-static void idestart(struct buf*);
+// A physical region descriptor: one piece of memory to move.
+struct prd {
+  uint addr;
+  ushort len;    // bytes; 0 means 64KB
+  ushort flags;
+};
 
-// Wait for IDE disk to become ready.
-static int
-idewait(int checkerr)
+#define PRD_EOT 0x8000  // last entry of the table
+
+#define IDEMAXSECT 256  // most sectors one command can move
+#define IDERETRIES 3    // tries of a failing command before giving up
+
+// Driver states.
+#define IDE_IDLE    0   // no command
+#define IDE_READY   1   // a command lined up, waiting for the drive
+#define IDE_RUNNING 2   // a command sent, waiting for interrupts
+
+// c->queue points to the bufs now being read/written to the
+// disk: c->count of them, lined up through qnext by idestart to
+// hold consecutive sectors.  c->pending holds the requests not
+// yet started, in the order the scheduler keeps them.
+// You must hold c->lock while manipulating either queue.
+//
+// The disk interrupts after every c->mult sectors of a PIO
+// command (READ/WRITE MULTIPLE); c->next is the first buf not
+// yet moved and c->left counts the bufs from there to the end
+// of the command.  c->tick is when the command was last sent or
+// moved along, and c->tries how often it has failed.
+struct idechan {
+  struct spinlock lock;
+  uint base;            // command block ports
+  uint ctl;             // device control port
+  int irq;
+  int havedisk[2];
+  int mult[2];          // sectors per interrupt on each drive
+  uint nsect[2];        // sectors on each drive, from IDENTIFY
+  uint bm;              // bus master I/O ports; 0 means PIO
+  struct prd *prdt;
+  struct iosched *sched;
+
+  struct buf *queue;
+  int count;
+  struct buf *pending;
+  int npending;
+  struct buf *next;
+  int left;
+  int state;
+  uint tick;
+  int tries;
+  uint clookhead;       // key of the sector after the last command
+
+  uint64 cycles;        // CPU time spent in the driver
+  uint pos[2];          // sector after the last command on each drive
+  uint reqs;            // requests queued
+  uint depth;           // sum of queue depths requests found
+  uint cmds;            // commands started
+  uint seek;            // sum of sectors the heads moved
+  uint errors;          // errors and timeouts recovered from
+};
+
+static struct idechan idechan[2] = {
+  { .base = 0x1f0, .ctl = 0x3f6, .irq = IRQ_IDE },
+  { .base = 0x170, .ctl = 0x376, .irq = IRQ_IDE+1 },
+};
+
+static void idestart(struct idechan*);
+static void idecmd(struct idechan*);
+
+// An I/O scheduler keeps c->pending in some order and picks the
+// request to start next.  Caller must hold c->lock.
+struct iosched {
+  char *name;
+  void (*add)(struct idechan*, struct buf*);  // put b on c->pending
+  struct buf **(*pick)(struct idechan*);      // link to the next one
+};
+
+// FIFO: requests go in the order they came.
+static void
+fifoadd(struct idechan *c, struct buf *b)
 {
-  int r;
+  struct buf **pp;
 
-  while(((r = inb(0x1f7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY) 
+  for(pp = &c->pending; *pp; pp = &(*pp)->qnext)
     ;
+  b->qnext = 0;
+  *pp = b;
+}
+
+static struct buf**
+fifopick(struct idechan *c)
+{
+  return &c->pending;
+}
+
+// C-LOOK keeps c->pending sorted by drive and sector, and
+// serves it in that order from where the last command ended.
+static uint
+clookkey(uint dev, uint sector)
+{
+  return (dev&1) << 28 | sector;
+}
+
+static void
+clookadd(struct idechan *c, struct buf *b)
+{
+  struct buf **pp;
+  uint key;
+
+  key = clookkey(b->dev, b->sector);
+  for(pp = &c->pending; *pp; pp = &(*pp)->qnext)
+    if(clookkey((*pp)->dev, (*pp)->sector) > key)
+      break;
+  b->qnext = *pp;
+  *pp = b;
+}
+
+static struct buf**
+clookpick(struct idechan *c)
+{
+  struct buf **pp, **old;
+
+  // A read that has waited too long goes first, oldest first.
+  old = 0;
+  for(pp = &c->pending; *pp; pp = &(*pp)->qnext){
+    if(((*pp)->flags & B_DIRTY) || ticks - (*pp)->qtime < IDEDEADLINE)
+      continue;
+    if(old == 0 || (int)((*pp)->qtime - (*old)->qtime) < 0)
+      old = pp;
+  }
+  if(old)
+    return old;
+
+  for(pp = &c->pending; *pp; pp = &(*pp)->qnext)
+    if(clookkey((*pp)->dev, (*pp)->sector) >= c->clookhead)
+      return pp;
+  return &c->pending;
+}
+
+static struct iosched ioscheds[] = {
+  { "clook", clookadd, clookpick },
+  { "fifo", fifoadd, fifopick },
+};
+
+// The channel of disk dev.
+static struct idechan*
+idechanof(uint dev)
+{
+  return &idechan[(dev >> 1) & 1];
+}
+
+// Wait for the selected drive of c to become ready, giving up
+// on an error or after a while, in case there is no drive.
+// Only used while setting the drives up at boot.
+static int
+idewait(struct idechan *c, int checkerr)
+{
+  int i, r;
+
+  for(i = 0; i < 1000000; i++){
+    r = inb(c->base + IDE_STATUS);
+    if(!(r & IDE_BSY) && (r & (IDE_DRDY|IDE_ERR)))
+      break;
+  }
+  if((r & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
+    return -1;
   if(checkerr && (r & (IDE_DF|IDE_ERR)) != 0)
     return -1;
   return 0;
 }
 
+// Wait the 400ns a drive takes to update its status, by
+// reading the alternate status register, which takes ~100ns.
+static void
+idedelay(struct idechan *c)
+{
+  inb(c->ctl);
+  inb(c->ctl);
+  inb(c->ctl);
+  inb(c->ctl);
+}
+
+// Look for an ATA disk as drive of c.  If there is one, note
+// its size, ask it how many sectors it can move per interrupt,
+// set it to do that many and return 0; if not, return -1.
+static int
+ideprobe(struct idechan *c, int drive)
+{
+  ushort id[256];
+  int n, st;
+
+  outb(c->ctl, 2);  // no interrupts
+  outb(c->base + IDE_DRIVE, 0xe0 | (drive<<4));
+  idedelay(c);
+  st = inb(c->base + IDE_STATUS);
+  if(st == 0 || st == 0xff)
+    return -1;
+  // An ATAPI drive (a CD-ROM) refuses IDENTIFY.
+  outb(c->base + IDE_CMD, IDE_CMD_IDENTIFY);
+  idedelay(c);
+  if(idewait(c, 1) < 0 || !(inb(c->base + IDE_STATUS) & IDE_DRQ))
+    return -1;
+  insl(c->base + IDE_DATA, id, 512/4);
+
+  c->nsect[drive] = id[60] | (id[61] << 16);  // LBA28 sectors
+  c->mult[drive] = 1;
+  n = id[47] & 0xff;
+  if(n <= 1)
+    return 0;
+  outb(c->base + IDE_COUNT, n);
+  outb(c->base + IDE_DRIVE, 0xe0 | (drive<<4));
+  outb(c->base + IDE_CMD, IDE_CMD_SETMUL);
+  if(idewait(c, 1) == 0)
+    c->mult[drive] = n;
+  return 0;
+}
+
+// Look for a PCI IDE controller that can master the bus (like
+// the PIIX that QEMU emulates) and set both channels up for DMA.
+static void
+idedmainit(void)
+{
+  struct pcidev d;
+  struct idechan *c;
+  uint bm;
+
+  if(!IDEDMA || pcifindclass(0x01, 0x01, &d) < 0 ||
+     !(d.progif & 0x80) || !(d.bar[4] & PCI_BAR_IO))
+    return;
+  pcienable(&d);
+  bm = d.bar[4] & PCI_BAR_IOMASK;
+  for(c = idechan; c < &idechan[2]; c++, bm += 8){
+    if((c->prdt = (struct prd*)kalloc()) == 0)
+      return;
+    c->bm = bm;
+    outb(c->bm + BM_STATUS, BM_DMACAP | BM_ERR | BM_INTR);
+  }
+  cprintf("ide: bus-master DMA at port 0x%x\n", idechan[0].bm);
+}
+
 void
 ideinit(void)
+{
+  struct idechan *c;
+  int drive, dev;
+
+  for(c = idechan; c < &idechan[2]; c++){
+    initlock(&c->lock, "ide");
+    c->sched = &ioscheds[0];
+    for(drive = 0; drive < 2; drive++){
+      if(ideprobe(c, drive) < 0)
+        continue;
+      c->havedisk[drive] = 1;
+      dev = (c - idechan)*2 + drive;
+      bdevsw[dev].rw = iderw;
+      bdevsw[dev].nsect = c->nsect[drive];
+    }
+    // Switch back to drive 0.
+    outb(c->base + IDE_DRIVE, 0xe0 | (0<<4));
+    if(c->havedisk[0] || c->havedisk[1]){
+      picenable(c->irq);
+      ioapicenable(c->irq, ncpu - 1);
+    }
+  }
+
+  idedmainit();
+}
+
+// Write the next block of sectors of the command, up to c->mult
+// of them.  Caller must hold c->lock.
+static void
+ideoutblock(struct idechan *c)
 {
   int i;
 
-  initlock(&idelock, "ide");
-  picenable(IRQ_IDE);
-  ioapicenable(IRQ_IDE, ncpu - 1);
-  idewait(0);
-  
-  // Check if disk 1 is present
-  outb(0x1f6, 0xe0 | (1<<4));
-  for(i=0; i<1000; i++){
-    if(inb(0x1f7) != 0){
-      havedisk1 = 1;
-      break;
+  for(i = 0; i < c->mult[c->queue->dev&1] && c->left > 0; i++){
+    outsl(c->base + IDE_DATA, c->next->data, 512/4);
+    c->next = c->next->qnext;
+    c->left--;
+  }
+}
+
+// Fill the PRD table with the data of the n bufs from b on and
+// get the bus master ready.  Caller must hold c->lock.
+static void
+idedmasetup(struct idechan *c, struct buf *b, int n)
+{
+  struct prd *p;
+  uint pa, len;
+  int i, write;
+
+  write = b->flags & B_DIRTY;
+  p = c->prdt;
+  for(i = 0; i < n; i++, b = b->qnext){
+    pa = V2P(b->data);
+    // An entry must not cross a 64KB boundary.
+    len = 0x10000 - (pa & 0xffff);
+    if(len < 512){
+      p->addr = pa;
+      p->len = len;
+      p->flags = 0;
+      p++;
+      pa += len;
+      len = 512 - len;
+    } else
+      len = 512;
+    p->addr = pa;
+    p->len = len;
+    p->flags = 0;
+    p++;
+  }
+  p[-1].flags = PRD_EOT;
+  outl(c->bm + BM_PRDT, V2P(c->prdt));
+  outb(c->bm + BM_CMD, write ? 0 : BM_READ);
+  outb(c->bm + BM_STATUS, inb(c->bm + BM_STATUS) | BM_ERR | BM_INTR);
+}
+
+// Take the pending request for sector on the drive of b, going
+// the same direction as b, off c->pending, and return it; or
+// return 0 if there is none.  The search starts at *hint, where
+// the last one was found, and on return *hint is where this
+// one was.  Caller must hold c->lock.
+static struct buf*
+idetake(struct idechan *c, struct buf ***hint, struct buf *b, uint sector)
+{
+  struct buf **pp, **end, *nb;
+
+  pp = *hint;
+  end = 0;
+  for(;;){
+    if(*pp == 0){
+      // Go round to the front, and stop at the hint.
+      if(end)
+        return 0;
+      end = *hint;
+      pp = &c->pending;
     }
+    if(end && pp == end)
+      return 0;
+    nb = *pp;
+    if(nb->dev == b->dev && nb->sector == sector &&
+       (nb->flags & B_DIRTY) == (b->flags & B_DIRTY))
+      break;
+    pp = &nb->qnext;
   }
-  
-  // Switch back to disk 0.
-  outb(0x1f6, 0xe0 | (0<<4));
+  *pp = nb->qnext;
+  c->npending--;
+  *hint = pp;
+  return nb;
 }
 
-// Start the request for b.  Caller must hold idelock.
+// If channel c is idle, start the request the scheduler picks,
+// together with the pending requests for the sectors right
+// after it.  Caller must hold c->lock.
 static void
-idestart(struct buf *b)
-{
-  if(b == 0)
-    panic("idestart");
-
-  idewait(0);
-  outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, 1);  // number of sectors
-  outb(0x1f3, b->sector & 0xff);
-  outb(0x1f4, (b->sector >> 8) & 0xff);
-  outb(0x1f5, (b->sector >> 16) & 0xff);
-  outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((b->sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
-    outb(0x1f7, IDE_CMD_WRITE);
-    outsl(0x1f0, b->data, 512/4);
+idestart(struct idechan *c)
+{
+  struct buf **pp, *b, *last, *nb;
+  uint *pos;
+  int n;
+
+  if(c->queue || c->pending == 0)
+    return;
+  pp = c->sched->pick(c);
+  b = *pp;
+  *pp = b->qnext;
+  c->npending--;
+
+  // Line up the requests for b->sector+1, b->sector+2, ...
+  // behind b.
+  last = b;
+  for(n = 1; n < IDEMAXSECT; n++){
+    if((nb = idetake(c, &pp, b, last->sector + 1)) == 0)
+      break;
+    last->qnext = nb;
+    last = nb;
+  }
+  last->qnext = 0;
+  c->queue = b;
+  c->count = n;
+  c->tries = 0;
+
+  c->cmds++;
+  pos = &c->pos[b->dev&1];
+  if(b->sector > *pos)
+    c->seek += b->sector - *pos;
+  else
+    c->seek += *pos - b->sector;
+  *pos = last->sector + 1;
+  c->clookhead = clookkey(b->dev, last->sector + 1);
+
+  idecmd(c);
+}
+
+// The command on c->queue failed or timed out.  Reset the
+// channel and send the command again, or give up after
+// IDERETRIES tries.  Caller must hold c->lock.
+static void
+idereset(struct idechan *c, char *why)
+{
+  cprintf("ide: %s at sector %d of disk %d\n",
+          why, c->queue->sector, c->queue->dev);
+  if(++c->tries > IDERETRIES)
+    panic("ide: disk failed");
+  c->errors++;
+  if(c->bm)
+    outb(c->bm + BM_CMD, 0);
+  outb(c->ctl, 0x06);  // reset, no interrupts
+  idedelay(c);
+  outb(c->ctl, 0x02);
+  // The drives may have forgotten their READ/WRITE MULTIPLE
+  // setting; plain READ/WRITE always works.
+  c->mult[0] = c->mult[1] = 1;
+  c->state = IDE_READY;
+  c->tick = ticks;
+  idecmd(c);
+}
+
+// Send the command for the c->count bufs on c->queue to the
+// disk if the drive is ready for it; if not, idetimer calls
+// again.  Caller must hold c->lock.
+static void
+idecmd(struct idechan *c)
+{
+  struct buf *b;
+  int n, cmd;
+
+  b = c->queue;
+  n = c->count;
+  if(c->state != IDE_READY){
+    c->state = IDE_READY;
+    c->tick = ticks;
+  }
+
+  outb(c->base + IDE_DRIVE,
+       0xe0 | ((b->dev&1)<<4) | ((b->sector>>24)&0x0f));
+  idedelay(c);
+  if((inb(c->base + IDE_STATUS) & (IDE_BSY|IDE_DRDY|IDE_DRQ)) != IDE_DRDY)
+    return;
+
+  c->state = IDE_RUNNING;
+  c->tick = ticks;
+  c->next = b;
+  c->left = n;
+  if(c->bm)
+    idedmasetup(c, b, n);
+  outb(c->ctl, 0);  // generate interrupt
+  outb(c->base + IDE_COUNT, n & 0xff);  // number of sectors; 0 means 256
+  outb(c->base + IDE_LBA0, b->sector & 0xff);
+  outb(c->base + IDE_LBA1, (b->sector >> 8) & 0xff);
+  outb(c->base + IDE_LBA2, (b->sector >> 16) & 0xff);
+  if(c->bm){
+    if(b->flags & B_DIRTY){
+      outb(c->base + IDE_CMD, IDE_CMD_WRDMA);
+      outb(c->bm + BM_CMD, BM_START);
+    } else {
+      outb(c->base + IDE_CMD, IDE_CMD_RDDMA);
+      outb(c->bm + BM_CMD, BM_READ | BM_START);
+    }
+  } else if(b->flags & B_DIRTY){
+    cmd = c->mult[b->dev&1] > 1 ? IDE_CMD_WRMUL : IDE_CMD_WRITE;
+    outb(c->base + IDE_CMD, cmd);
+    // The drive asks for the first block with DRQ rather than
+    // an interrupt.  It is quick to; if not, idetimer sends it.
+    idedelay(c);
+    if(inb(c->base + IDE_STATUS) & IDE_DRQ)
+      ideoutblock(c);
   } else {
-    outb(0x1f7, IDE_CMD_READ);
+    cmd = c->mult[b->dev&1] > 1 ? IDE_CMD_RDMUL : IDE_CMD_READ;
+    outb(c->base + IDE_CMD, cmd);
   }
 }
 
-// Interrupt handler.
+// Interrupt handler for channel chan: the disk has finished a
+// DMA command, or moved a block of sectors of a PIO one.
 void
-ideintr(void)
+ideintr(int chan)
 {
-  struct buf *b;
+  struct idechan *c;
+  struct buf *b, *async;
+  uint64 t;
+  uint st;
+  int i;
 
-  // Take first buffer off queue.
-  acquire(&idelock);
-  if((b = idequeue) == 0){
-    release(&idelock);
+  t = rdtsc();
+  c = &idechan[chan];
+  acquire(&c->lock);
+  async = 0;
+  if(c->state != IDE_RUNNING){
     // cprintf("spurious IDE interrupt\n");
-    return;
+    inb(c->base + IDE_STATUS);
+    goto out;
+  }
+
+  b = c->queue;
+  if(c->bm){
+    st = inb(c->bm + BM_STATUS);
+    if(!(st & BM_INTR))
+      goto out;
+    outb(c->bm + BM_CMD, 0);
+    outb(c->bm + BM_STATUS, st | BM_ERR | BM_INTR);
+    if((st & BM_ERR) || (inb(c->base + IDE_STATUS) & (IDE_DF|IDE_ERR))){
+      cprintf("ide: DMA failed, using PIO\n");
+      c->bm = 0;
+      c->errors++;
+      idecmd(c);
+      goto out;
+    }
+    c->left = 0;
+  } else {
+    // Reading the status also acknowledges the interrupt.
+    st = inb(c->base + IDE_STATUS);
+    if(st & IDE_BSY)
+      goto out;
+    if(st & (IDE_DF|IDE_ERR)){
+      idereset(c, "disk error");
+      goto out;
+    }
+    if(!(b->flags & B_DIRTY)){
+      // Read data.
+      if(!(st & IDE_DRQ))
+        goto out;
+      for(i = 0; i < c->mult[b->dev&1] && c->left > 0; i++){
+        insl(c->base + IDE_DATA, c->next->data, 512/4);
+        c->next = c->next->qnext;
+        c->left--;
+      }
+    } else if(c->left > 0){
+      // The disk is ready for the next block.
+      if(st & IDE_DRQ){
+        ideoutblock(c);
+        c->tick = ticks;
+      }
+      goto out;
+    }
+  }
+  if(c->left > 0){
+    // More sectors to come.
+    c->tick = ticks;
+    goto out;
+  }
+
+  // The command is done.  Take its bufs off the queue and wake
+  // the processes waiting for them.
+  for(i = 0; i < c->count; i++){
+    b = c->queue;
+    c->queue = b->qnext;
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wakeup(b);
+    if(b->flags & B_ASYNC){
+      b->qnext = async;
+      async = b;
+    }
   }
-  idequeue = b->qnext;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, 512/4);
-  
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
-  
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  c->count = 0;
+  c->state = IDE_IDLE;
+
+  // Start disk on next request.
+  idestart(c);
 
-  release(&idelock);
+ out:
+  c->cycles += rdtsc() - t;
+  release(&c->lock);
+
+  // Nobody is waiting for the asynchronous requests: give their
+  // buffers back to the cache.
+  while((b = async) != 0){
+    async = b->qnext;
+    b->flags &= ~B_ASYNC;
+    brelse(b);
+  }
 }
 
-// Sync buf with disk. 
+// Called on every clock tick.  Send a command a drive was not
+// ready for, or the first block of a PIO write it was not ready
+// to take, and reset a command that has stopped moving.
+void
+idetimer(void)
+{
+  struct idechan *c;
+  uint64 t;
+
+  for(c = idechan; c < &idechan[2]; c++){
+    if(!c->havedisk[0] && !c->havedisk[1])
+      continue;
+    t = rdtsc();
+    acquire(&c->lock);
+    if(c->state != IDE_IDLE && ticks - c->tick >= IDETIMEOUT)
+      idereset(c, c->state == IDE_READY ? "drive not ready" : "timeout");
+    else if(c->state == IDE_READY)
+      idecmd(c);
+    else if(c->state == IDE_RUNNING && !c->bm && c->left == c->count &&
+            (c->queue->flags & B_DIRTY) &&
+            (inb(c->base + IDE_STATUS) & IDE_DRQ)){
+      ideoutblock(c);
+      c->tick = ticks;
+    }
+    c->cycles += rdtsc() - t;
+    release(&c->lock);
+  }
+}
+
+// Sync buf with disk.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// The bufs on list's rwnext chain, all on the same disk and
+// all asynchronous or none, are queued together before the
+// disk starts, so idestart can merge consecutive ones into one
+// command.  If B_ASYNC is set, return at once; ideintr releases
+// each buf when the disk is done with it.
 void
-iderw(struct buf *b)
+iderw(struct buf *list)
 {
-  struct buf **pp;
+  struct idechan *c;
+  struct buf *b;
+  uint64 t;
 
-  if(!(b->flags & B_BUSY))
-    panic("iderw: buf not busy");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("iderw: nothing to do");
-  if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
+  for(b = list; b; b = b->rwnext){
+    if(!(b->flags & B_BUSY))
+      panic("iderw: buf not busy");
+    if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+      panic("iderw: nothing to do");
+    if(b->dev != list->dev || (b->flags & B_ASYNC) != (list->flags & B_ASYNC))
+      panic("iderw: mixed list");
+  }
+  c = idechanof(list->dev);
+  if(list->dev >= 4 || !c->havedisk[list->dev&1])
+    panic("iderw: no such ide disk");
 
-  acquire(&idelock);
+  t = rdtsc();
+  acquire(&c->lock);
+
+  // Hand the bufs to the scheduler.
+  for(b = list; b; b = b->rwnext){
+    c->reqs++;
+    c->depth += c->npending + c->count;
+    b->qtime = ticks;
+    c->sched->add(c, b);
+    c->npending++;
+  }
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)
-    ;
-  *pp = b;
-  
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
-  
-  // Wait for request to finish.
+  idestart(c);
+  c->cycles += rdtsc() - t;
+
+  // Don't wait for an asynchronous request.
+  if(list->flags & B_ASYNC){
+    release(&c->lock);
+    return;
+  }
+
+  // Wait for the requests to finish.
   // Assuming will not sleep too long: ignore proc->killed.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
+  for(b = list; b; b = b->rwnext){
+    while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
+      sleep(b, &c->lock);
+    }
+  }
+
+  release(&c->lock);
+}
+
+// Report disk driver statistics, summed over the channels, for
+// the sysinfo system call.
+void
+idestat(struct sysinfo *si)
+{
+  struct idechan *c;
+  uint64 cycles;
+
+  cycles = 0;
+  for(c = idechan; c < &idechan[2]; c++){
+    acquire(&c->lock);
+    cycles += c->cycles;
+    si->idedma |= c->bm != 0;
+    si->ideerrors += c->errors;
+    si->idereqs += c->reqs;
+    si->idedepth += c->depth;
+    si->idecmds += c->cmds;
+    si->ideseek += c->seek;
+    release(&c->lock);
   }
+  si->idecycles = cycles >> 10;
+  safestrcpy(si->iosched, idechan[0].sched->name, sizeof(si->iosched));
+}
+
+// Switch both channels to the I/O scheduler called name, and let
+// it reorder the pending requests.  Returns 0, or -1 if there is
+// no such scheduler.
+int
+iosched(char *name)
+{
+  struct iosched *s;
+  struct idechan *c;
+  struct buf *b, *list;
+
+  for(s = ioscheds; s < &ioscheds[NELEM(ioscheds)]; s++)
+    if(strncmp(s->name, name, strlen(s->name) + 1) == 0)
+      break;
+  if(s == &ioscheds[NELEM(ioscheds)])
+    return -1;
 
-  release(&idelock);
+  for(c = idechan; c < &idechan[2]; c++){
+    acquire(&c->lock);
+    c->sched = s;
+    list = c->pending;
+    c->pending = 0;
+    while((b = list) != 0){
+      list = b->qnext;
+      s->add(c, b);
+    }
+    release(&c->lock);
+  }
+  return 0;
 }
@@ -1,12 +1,23 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Free pages sit on one of two lists: freelist, whose pages hold
+// whatever was last written to them, and zerolist, whose pages
+// idle CPUs have already cleared (see kzero).  kalloc_zeroed
+// serves page tables and fresh user memory from zerolist, so
+// they need not be cleared on the allocation path.
+//
+// Build with -DKALLOC_POISON (see Makefile) to fill freed pages
+// with junk, to catch dangling references.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "memlayout.h"
 #include "spinlock.h"
+#include "sysinfo.h"
 
 struct run {
   struct run *next;
@@ -14,43 +25,194 @@ struct run {
 
 struct {
   struct spinlock lock;
+  int use_lock;
   struct run *freelist;
+  struct run *zerolist;  // free pages known to be all zeros
+  uint npage;   // pages handed to the allocator by kinit
+  uint nfree;   // pages on either free list
+  uint nzero;   // pages on zerolist
 } kmem;
 
 extern char end[]; // first address after kernel loaded from ELF file
 
-// Initialize free list of physical pages.
+// End of the highest page of RAM in the free pool (a physical
+// address).  Set by kinit1 from the boot loader's memory map.
+uint phystop;
+
+// One entry of the BIOS E820 memory map.  The multiboot
+// memory map uses the same layout, preceded by a size field.
+struct e820entry {
+  uint addr;     // base address, low and high 32 bits
+  uint addrhi;
+  uint len;      // length in bytes, low and high 32 bits
+  uint lenhi;
+  uint type;
+};
+#define E820_RAM 1  // usable memory
+
+// Multiboot information block; see multiboot.S.
+#define MB_MAGIC   0x2BADB002  // %eax from a multiboot loader
+#define MB_MEMINFO (1<<0)      // mem_lower, mem_upper are valid
+#define MB_MMAP    (1<<6)      // mmap_length, mmap_addr are valid
+struct mbinfo {
+  uint flags;
+  uint mem_lower;     // KB of memory below 1MB
+  uint mem_upper;     // KB of memory above 1MB
+  uint boot_device;
+  uint cmdline;
+  uint mods_count;
+  uint mods_addr;
+  uint syms[4];
+  uint mmap_length;   // bytes of memory map
+  uint mmap_addr;     // memory map entries, each preceded by its size
+};
+extern uint mbmagic;
+extern uint mbinfo;   // physical address of struct mbinfo
+
+static void memmap(void (*)(uint, uint));
+static void ramtop(uint, uint);
+static void freerange(uint, uint);
+
+// Physical range that freerange() currently adds to the pool.
+static uint freelo, freehi;
+
+// Initialization happens in two phases.
+// 1. main() calls kinit1() while still using entrypgdir, which
+// maps only the first 4MB, to get pages for the kernel page table.
+// 2. main() calls kinit2() with the kernel page table installed
+// to add the rest of RAM.  Every RAM region the boot loader
+// reports goes into the pool, except what lies below the end
+// of the kernel or above PHYSTOP.
 void
-kinit(void)
+kinit1(void)
+{
+  initlock(&kmem.lock, "kmem");
+  kmem.use_lock = 0;
+  memmap(ramtop);
+  freelo = V2P(end);
+  freehi = 4*1024*1024;
+  memmap(freerange);
+}
+
+void
+kinit2(void)
+{
+  freelo = 4*1024*1024;
+  freehi = PHYSTOP;
+  memmap(freerange);
+  kmem.use_lock = 1;
+  cprintf("kinit: %d pages (%d MB) free, phystop 0x%x\n",
+          kmem.npage, kmem.npage / (1024*1024/PGSIZE), phystop);
+}
+
+// Call f(addr, len) for each region of RAM in the memory map
+// that the boot loader left behind.
+static void
+memmap(void (*f)(uint, uint))
+{
+  struct e820entry *e, *ee;
+  struct mbinfo *mb;
+  uint *mp, *emp;
+
+  mb = P2V(mbinfo);
+  if(mbmagic == MB_MAGIC && (mb->flags & MB_MMAP)){
+    mp = P2V(mb->mmap_addr);
+    emp = P2V(mb->mmap_addr + mb->mmap_length);
+    for(; mp < emp; mp = (uint*)((char*)mp + *mp + 4)){
+      e = (struct e820entry*)(mp + 1);
+      if(e->type == E820_RAM && e->addrhi == 0)
+        f(e->addr, e->lenhi ? 0xFFFFFFFF : e->len);
+    }
+  } else if(mbmagic == MB_MAGIC && (mb->flags & MB_MEMINFO)){
+    f(EXTMEM, mb->mem_upper * 1024);
+  } else if(mbmagic != MB_MAGIC && *(uint*)P2V(E820MAP) != 0){
+    e = P2V(E820MAP + 4);
+    ee = e + *(uint*)P2V(E820MAP);
+    for(; e < ee; e++)
+      if(e->type == E820_RAM && e->addrhi == 0)
+        f(e->addr, e->lenhi ? 0xFFFFFFFF : e->len);
+  } else {
+    // No usable map (e.g. a BIOS without E820): assume 16MB,
+    // which is what xv6 always used to do.
+    f(EXTMEM, 0x1000000 - EXTMEM);
+  }
+}
+
+// Clip RAM region [addr, addr+len) to the pages the kernel may
+// use, setting *lo and *hi.  Returns 0 if nothing is left.
+static int
+cliprange(uint addr, uint len, uint *lo, uint *hi)
+{
+  *lo = addr;
+  *hi = addr + len;
+  if(*hi < *lo)  // wraps past 4GB
+    *hi = 0xFFFFFFFF;
+  if(*lo < V2P(end))
+    *lo = V2P(end);
+  if(*hi > PHYSTOP)
+    *hi = PHYSTOP;
+  if(*lo >= *hi)
+    return 0;
+  *lo = PGROUNDUP(*lo);
+  *hi = (uint)PGROUNDDOWN(*hi);
+  return *lo < *hi;
+}
+
+// Raise phystop to cover RAM region [addr, addr+len).
+static void
+ramtop(uint addr, uint len)
 {
+  uint lo, hi;
+
+  if(cliprange(addr, len, &lo, &hi) && hi > phystop)
+    phystop = hi;
+}
+
+// Add the pages of RAM region [addr, addr+len) that fall
+// between freelo and freehi to the free pool.
+static void
+freerange(uint addr, uint len)
+{
+  uint lo, hi;
   char *p;
 
-  initlock(&kmem.lock, "kmem");
-  p = (char*)PGROUNDUP((uint)end);
-  for(; p + PGSIZE <= (char*)PHYSTOP; p += PGSIZE)
+  if(!cliprange(addr, len, &lo, &hi))
+    return;
+  if(lo < freelo)
+    lo = freelo;
+  if(hi > freehi)
+    hi = freehi;
+  for(p = P2V(lo); p + PGSIZE <= (char*)P2V(hi); p += PGSIZE){
+    kmem.npage++;
     kfree(p);
+  }
 }
 
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// initializing the allocator; see kinit1 above.)
 void
 kfree(char *v)
 {
   struct run *r;
 
-  if((uint)v % PGSIZE || v < end || (uint)v >= PHYSTOP) 
+  if((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
     panic("kfree");
 
+#ifdef KALLOC_POISON
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  acquire(&kmem.lock);
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
-  release(&kmem.lock);
+  kmem.nfree++;
+  if(kmem.use_lock)
+    release(&kmem.lock);
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -61,11 +223,84 @@ kalloc(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
-  release(&kmem.lock);
+    kmem.nfree--;
+  } else if((r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    kmem.nfree--;
+  }
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  return (char*)r;
+}
+
+// Allocate one 4096-byte page of physical memory filled
+// with zeros, preferably one that is zeroed already.
+// Returns 0 if the memory cannot be allocated.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  r = kmem.zerolist;
+  if(r){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    kmem.nfree--;
+  }
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  if(r){
+    r->next = 0;  // the only word that isn't zero
+    return (char*)r;
+  }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
   return (char*)r;
 }
 
+// Zero one page from freelist and move it to zerolist.
+// Called by the scheduler when it finds nothing to run.
+// Returns 0 if there was no page left to zero.
+int
+kzero(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  if((r = kmem.freelist) != 0){
+    kmem.freelist = r->next;
+    kmem.nfree--;
+  }
+  release(&kmem.lock);
+  if(r == 0)
+    return 0;
+
+  memset(r, 0, PGSIZE);
+
+  acquire(&kmem.lock);
+  r->next = kmem.zerolist;
+  kmem.zerolist = r;
+  kmem.nzero++;
+  kmem.nfree++;
+  release(&kmem.lock);
+  return 1;
+}
+
+// Report memory totals for the sysinfo system call.
+void
+kmemstat(struct sysinfo *si)
+{
+  acquire(&kmem.lock);
+  si->totalram = kmem.npage * PGSIZE;
+  si->freeram = kmem.nfree * PGSIZE;
+  si->zeroram = kmem.nzero * PGSIZE;
+  release(&kmem.lock);
+}
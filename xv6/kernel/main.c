@@ -2,6 +2,7 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "memlayout.h"
 #include "proc.h"
 #include "x86.h"
 
@@ -10,17 +11,20 @@ static void mpmain(void);
 void jmpkstack(void)  __attribute__((noreturn));
 void mainc(void);
 static void cinit(void);
+extern pde_t entrypgdir[];  // For bootothers and multiboot.S
 
-// Bootstrap processor starts running C code here.
+// Bootstrap processor starts running C code here, on entrypgdir.
 // Allocate a real stack and switch to it, first
 // doing some setup required for memory allocator to work.
 int
 main(void)
 {
+  kinit1();        // pages from the first 4MB of phys mem
+  kvmalloc();      // kernel page table
   mpinit();        // collect info about this machine
   lapicinit(mpbcpu());
   seginit();       // set up segments
-  kinit();         // initialize memory allocator
+  kinit2();        // rest of phys mem
   jmpkstack();       // call mainc() on a properly-allocated stack 
 }
 
@@ -47,13 +51,19 @@ mainc(void)
   ioapicinit();    // another interrupt controller
   consoleinit();   // I/O devices & their interrupts
   uartinit();      // serial port
-  kvmalloc();      // initialize the kernel page table
   pinit();         // process table
+  shminit();       // shared memory segments
+  futexinit();     // futex wait queues
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcinit();        // page cache
   fileinit();      // file table
   iinit();         // inode cache
+  dcinit();        // directory entry cache
   ideinit();       // disk
+  if(virtioinit() == 0)  // virtio disk, the root if there is one
+    rootdev = VIRTIODEV;
+  swapinit();      // swap space
   if(!ismp)
     timerinit();   // uniprocessor timer
   bootothers();    // start other processors
@@ -61,19 +71,22 @@ mainc(void)
   cinit();
   sti();           // enable inturrupts
   userinit();      // first user process
+  kproc("bflushd", bflushd);  // buffer cache flusher
+  kproc("ireclaimd", ireclaimd);  // frees unlinked inodes
   scheduler();     // start running processes
 }
 
 // common cpu init code
 static void
 cinit(void) {
+  switchkvm();     // other CPUs arrive on entrypgdir
   if(cpunum() != mpbcpu()){
     seginit();
     lapicinit(cpunum());
   }
-  vmenable();        // turn on paging
   cprintf("cpu%d: starting\n", cpu->id);
   idtinit();       // load idt register
+  fpuinit();       // FPU and SSE
   xchg(&cpu->booted, 1); // tell bootothers() we're up
 }
 
@@ -99,20 +112,22 @@ bootothers(void)
   // Write bootstrap code to unused memory at 0x7000.
   // The linker has placed the image of bootother.S in
   // _binary_bootother_start.
-  code = (uchar*)0x7000;
+  code = P2V(0x7000);
   memmove(code, _binary_bootother_start, (uint)_binary_bootother_size);
   for(c = cpus; c < cpus+ncpu; c++){
     if(c == cpus+cpunum())  // We've started already.
       continue;
 
-    // Tell bootother.S what stack to use and the address of mpmain;
-    // it expects to find these two addresses stored just before
-    // its first instruction.
+    // Tell bootother.S what stack to use, the address of mpmain,
+    // and the page directory to turn paging on with; it expects
+    // to find these three addresses stored just before its first
+    // instruction.
     stack = kalloc();
     *(void**)(code-4) = stack + KSTACKSIZE;
     *(void**)(code-8) = mpmain;
+    *(uint*)(code-12) = V2P(entrypgdir);
 
-    lapicstartap(c->id, (uint)code);
+    lapicstartap(c->id, V2P(code));
 
     // Wait for cpu to finish mpmain()
     while(c->booted == 0)
@@ -120,5 +135,18 @@ bootothers(void)
   }
 }
 
+// Boot page table used in multiboot.S and bootother.S.
+// Page directories (and page tables) must start on a page
+// boundary, hence the aligned attribute.  PTE_PS in a page
+// directory entry enables 4MB pages.
+// It maps virtual addresses [0, 4MB) and [KERNBASE, KERNBASE+4MB)
+// both to physical [0, 4MB): the low mapping keeps the boot code
+// running at its physical address until it jumps up to main.
+__attribute__((__aligned__(PGSIZE)))
+pde_t entrypgdir[NPDENTRIES] = {
+  [0] = (0) | PTE_P | PTE_W | PTE_PS,
+  [KERNBASE>>PDXSHIFT] = (0) | PTE_P | PTE_W | PTE_PS,
+};
+
 // Blank page.
 
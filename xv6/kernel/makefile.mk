@@ -3,21 +3,29 @@
 KERNEL_OBJECTS := \
 	bio.o\
 	console.o\
+	dcache.o\
 	exec.o\
 	file.o\
+	fpu.o\
 	fs.o\
+	futex.o\
 	ide.o\
 	ioapic.o\
 	kalloc.o\
 	kbd.o\
 	lapic.o\
 	main.o\
+	mmap.o\
 	mp.o\
+	pcache.o\
+	pci.o\
 	picirq.o\
 	pipe.o\
 	proc.o\
+	shm.o\
 	spinlock.o\
 	string.o\
+	swap.o\
 	swtch.o\
 	syscall.o\
 	sysfile.o\
@@ -27,6 +35,7 @@ KERNEL_OBJECTS := \
 	trap.o\
 	uart.o\
 	vectors.o\
+	virtio.o\
 	vm.o\
 
 KERNEL_OBJECTS := $(addprefix kernel/, $(KERNEL_OBJECTS))
@@ -77,6 +86,8 @@ KERNEL_CFLAGS += -fno-strict-aliasing
 KERNEL_CFLAGS += -fno-stack-protector
 # generate code for 32-bit environment
 KERNEL_CFLAGS += -m32
+# keep the compiler away from the FPU/SSE registers, which hold user state
+KERNEL_CFLAGS += -mno-sse -mno-mmx
 
 KERNEL_ASFLAGS += $(KERNEL_CFLAGS)
 
@@ -87,16 +98,17 @@ KERNEL_LDFLAGS += -nostdlib
 # use simple contiguous section layout and do not use dynamic linking
 KERNEL_LDFLAGS += --omagic
 
-# bootable disk image
+# bootable disk image: boot block and kernel in the first 10000
+# sectors, then the swap area (SWAPSTART and NSWAP in param.h)
 xv6.img: kernel/bootblock kernel/kernel
-	dd if=/dev/zero of=xv6.img count=10000
+	dd if=/dev/zero of=xv6.img count=42768
 	dd if=kernel/bootblock of=xv6.img conv=notrunc
 	dd if=kernel/kernel of=xv6.img seek=1 conv=notrunc
 
 kernel/kernel:	\
 		$(KERNEL_OBJECTS) kernel/multiboot.o kernel/data.o bootother initcode
 	$(LD) $(LDFLAGS) $(KERNEL_LDFLAGS) \
-		--section-start=.text=0x100000 --entry=main --output=kernel/kernel \
+		--section-start=.text=0x80100000 --entry=_start --output=kernel/kernel \
 		kernel/multiboot.o kernel/data.o $(KERNEL_OBJECTS) \
 		-b binary initcode bootother
 
@@ -0,0 +1,27 @@
+#ifndef _MEMLAYOUT_H_
+#define _MEMLAYOUT_H_
+// Memory layout
+
+#define EXTMEM    0x100000    // Start of extended memory
+#define DEVSPACE  0xFE000000  // Other devices are at high addresses
+
+// Key addresses for address space layout (see kmap in vm.c).
+// User memory runs from 0 up to KERNBASE (USERTOP in param.h);
+// above it every page table maps physical memory and the kernel.
+#define KERNBASE  0x80000000          // First kernel virtual address
+#define KERNLINK  (KERNBASE+EXTMEM)   // Address where kernel is linked
+#define PHYSTOP   (DEVSPACE-KERNBASE) // Top physical memory the kernel maps
+
+#define V2P(a) (((uint) (a)) - KERNBASE)
+#define P2V(a) ((void*) (((char*) (a)) + KERNBASE))
+
+#define V2P_WO(x) ((x) - KERNBASE)    // same as V2P, but without casts
+#define P2V_WO(x) ((x) + KERNBASE)    // same as P2V, but without casts
+
+// bootasm.S asks the BIOS for the physical memory map (INT 0x15,
+// E820) before leaving real mode and leaves it at this physical
+// address for kinit1(): a uint count followed by that many 20-byte
+// E820 entries.
+#define E820MAP   0x8000
+
+#endif // _MEMLAYOUT_H_
@@ -0,0 +1,205 @@
+// Memory-mapped files.
+//
+// mmap maps pages of the page cache (pcache.c) straight into
+// the caller's address space, so loads and stores through the
+// mapping touch the same memory that read and write copy from
+// and to.  Mappings are shared: a store is visible to every
+// process mapping the file and to read() at once, and reaches
+// the disk when the mapping goes away (munmap, exit, exec).
+//
+// Each process has NMMAP mapping slots; slot i always lives at
+// MMAPBASE + i*MMAPMAX, between the heap and the shared memory
+// segments.  The slot holds a reference to the inode and to
+// every page it maps, so neither can be recycled under it.
+// fork gives the child the same mappings.  Threads share the
+// slots of their leader, under vmlock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "stat.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "pcache.h"
+
+#define MMAPADDR(i) (MMAPBASE + (i)*MMAPMAX)
+
+// Map the pages of v into pgdir at va.
+static int
+mmapmap(pde_t *pgdir, uint va, struct vma *v)
+{
+  char *pages[MMAPMAX/PGSIZE];
+  int i;
+
+  for(i = 0; i < v->npages; i++)
+    pages[i] = v->pages[i]->data;
+  return mapshared(pgdir, va, pages, v->npages,
+                   v->writable ? PTE_W|PTE_U : PTE_U);
+}
+
+// Drop the page and inode references held by v.
+static void
+mmapput(struct vma *v)
+{
+  int i;
+
+  for(i = 0; i < v->npages; i++)
+    pcput(v->pages[i]);
+  iput(v->ip);
+  v->ip = 0;
+}
+
+// Write back the dirty pages of mapping i of the current
+// process, unmap it and drop its references.
+static void
+mmapfree(int i)
+{
+  struct vma *v;
+  uint va;
+  int j;
+
+  v = &procleader(proc)->mmaps[i];
+  va = MMAPADDR(i);
+  if(v->writable){
+    ilock(v->ip);
+    for(j = 0; j < v->npages; j++)
+      if(uvmdirty(proc->pgdir, va + j*PGSIZE))
+        iwritepage(v->ip, v->off + j*PGSIZE, v->pages[j]->data);
+    iunlock(v->ip);
+  }
+  unmapshared(proc->pgdir, va, v->npages);
+  tlbshootdown(proc->pgdir);
+  mmapput(v);
+}
+
+// Map len bytes of f starting at off, which must be page
+// aligned, into the current process.  Returns the address of
+// the mapping, or 0 on error.
+char*
+mmap(struct file *f, uint off, uint len, int prot)
+{
+  struct inode *ip;
+  struct vma *v;
+  int i, j;
+
+  if(f->type != FD_INODE || len == 0 || len > MMAPMAX ||
+     off % PGSIZE != 0 || (prot & ~(PROT_READ|PROT_WRITE)) != 0)
+    return 0;
+  if(!f->readable || ((prot & PROT_WRITE) && !f->writable))
+    return 0;
+  vmlock();
+  for(i = 0; i < NMMAP; i++)
+    if(procleader(proc)->mmaps[i].ip == 0)
+      break;
+  if(i == NMMAP)
+    goto bad;
+  v = &procleader(proc)->mmaps[i];
+
+  ip = f->ip;
+  ilock(ip);
+  if(ip->type != T_FILE || off + len > PGROUNDUP(ip->size)){
+    iunlock(ip);
+    goto bad;
+  }
+  v->npages = PGROUNDUP(len) / PGSIZE;
+  for(j = 0; j < v->npages; j++){
+    if((v->pages[j] = pcget(ip, off + j*PGSIZE)) == 0){
+      while(--j >= 0)
+        pcput(v->pages[j]);
+      iunlock(ip);
+      goto bad;
+    }
+  }
+  iunlock(ip);
+
+  v->ip = idup(ip);
+  v->off = off;
+  v->writable = (prot & PROT_WRITE) != 0;
+  if(mmapmap(proc->pgdir, MMAPADDR(i), v) < 0){
+    mmapput(v);
+    goto bad;
+  }
+  vmunlock();
+  return (char*)MMAPADDR(i);
+
+bad:
+  vmunlock();
+  return 0;
+}
+
+// Remove the mapping at addr, which must be the address mmap
+// returned and len its length.
+int
+munmap(char *addr, uint len)
+{
+  struct vma *v;
+  int i;
+
+  if((uint)addr < MMAPBASE || (uint)addr >= SHMBASE)
+    return -1;
+  i = ((uint)addr - MMAPBASE) / MMAPMAX;
+  vmlock();
+  v = &procleader(proc)->mmaps[i];
+  if((uint)addr != MMAPADDR(i) || v->ip == 0 ||
+     PGROUNDUP(len) / PGSIZE != v->npages){
+    vmunlock();
+    return -1;
+  }
+  mmapfree(i);
+  vmunlock();
+  return 0;
+}
+
+// Remove every mapping of the current process, which is
+// exiting or replacing its address space and has no threads.
+void
+mmapexit(void)
+{
+  int i;
+
+  for(i = 0; i < NMMAP; i++)
+    if(proc->mmaps[i].ip)
+      mmapfree(i);
+}
+
+// Give child np the current process's mappings.
+int
+mmapcopy(struct proc *np)
+{
+  struct vma *v, *nv;
+  int i, j;
+
+  vmlock();
+  for(i = 0; i < NMMAP; i++){
+    v = &procleader(proc)->mmaps[i];
+    if(v->ip == 0)
+      continue;
+    nv = &np->mmaps[i];
+    *nv = *v;
+    idup(nv->ip);
+    for(j = 0; j < nv->npages; j++)
+      pcdup(nv->pages[j]);
+    if(mmapmap(np->pgdir, MMAPADDR(i), nv) < 0){
+      mmapput(nv);
+      goto bad;
+    }
+  }
+  vmunlock();
+  return 0;
+
+bad:
+  // Undo the mappings made so far.
+  while(--i >= 0){
+    nv = &np->mmaps[i];
+    if(nv->ip){
+      unmapshared(np->pgdir, MMAPADDR(i), nv->npages);
+      mmapput(nv);
+    }
+  }
+  vmunlock();
+  return -1;
+}
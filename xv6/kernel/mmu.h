@@ -39,6 +39,10 @@
 #define CR0_CD		0x40000000	// Cache Disable
 #define CR0_PG		0x80000000	// Paging
 
+#define CR4_PSE		0x00000010	// Page size extension
+#define CR4_OSFXSR	0x00000200	// OS supports FXSAVE/FXRSTOR
+#define CR4_OSXMMEXCPT	0x00000400	// OS handles SIMD exceptions
+
 // Segment Descriptor
 struct segdesc {
   uint lim_15_0 : 16;  // Low bits of segment limit
@@ -107,16 +111,12 @@ struct segdesc {
 // construct linear address from indexes and offset
 #define PGADDR(d, t, o)	((uint)((d) << PDXSHIFT | (t) << PTXSHIFT | (o)))
 
-// turn a kernel linear address into a physical address.
-// all of the kernel data structures have linear and
-// physical addresses that are equal.
-#define PADDR(a)       ((uint)(a))
-
 // Page directory and page table constants.
 #define NPDENTRIES	1024		// page directory entries per page directory
 #define NPTENTRIES	1024		// page table entries per page table
 
 #define PGSIZE		4096		// bytes mapped by a page
+#define PTSIZE		(PGSIZE*NPTENTRIES) // bytes mapped by a page directory entry
 #define PGSHIFT		12		// log2(PGSIZE)
 
 #define PTXSHIFT	12		// offset of PTX in a linear address
@@ -135,6 +135,7 @@ struct segdesc {
 #define PTE_D		0x040	// Dirty
 #define PTE_PS		0x080	// Page Size
 #define PTE_MBZ		0x180	// Bits must be zero
+#define PTE_SWAP	0x200	// Paged out to swap (with PTE_P clear)
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)	((uint)(pte) & ~0xFFF)
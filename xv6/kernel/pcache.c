@@ -0,0 +1,172 @@
+// Page cache.
+//
+// The page cache holds file contents a page at a time, so that
+// readi can copy whole pages out of memory and mmap can map
+// the same pages into user address spaces.  Each in-core inode
+// keeps a list of its cached pages (ip->pages); all entries are
+// also on one LRU list, and an entry nobody holds is reused
+// for another page when the cache is full.
+//
+// Interface:
+// * pcget(ip, off) returns the page at file offset off, reading
+//   it in if necessary; pclookup returns it only if cached.
+//   pcdup takes another reference and pcput drops one.
+// * The caller of pcget and pclookup must hold ip's lock, which
+//   keeps two processes from loading the same page.
+// * Pages are filled with bread and written back with bwrite.
+//   The buffers used for a cached page are marked B_COLD, so
+//   the buffer cache reuses them first and the data ends up
+//   held once, in the page cache, rather than twice.
+// * writei keeps cached pages up to date, so a cached page is
+//   never older than the disk.  A page written through a shared
+//   mapping is newer; mmap.c writes it back on munmap and exit.
+// * pcdrop(ip) forgets ip's pages when ip's contents go away or
+//   its icache slot is reused.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "file.h"
+#include "pcache.h"
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCACHE];
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently used.
+  struct pcpage head;
+} pcache;
+
+void
+pcinit(void)
+{
+  struct pcpage *p;
+
+  initlock(&pcache.lock, "pcache");
+
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  for(p = pcache.page; p < pcache.page+NPCACHE; p++){
+    p->next = pcache.head.next;
+    p->prev = &pcache.head;
+    pcache.head.next->prev = p;
+    pcache.head.next = p;
+  }
+}
+
+// Move p to the front of the LRU list.  Caller holds pcache.lock.
+static void
+pctouch(struct pcpage *p)
+{
+  p->next->prev = p->prev;
+  p->prev->next = p->next;
+  p->next = pcache.head.next;
+  p->prev = &pcache.head;
+  pcache.head.next->prev = p;
+  pcache.head.next = p;
+}
+
+// Take p off its inode's page list.  Caller holds pcache.lock.
+static void
+pcunlink(struct pcpage *p)
+{
+  struct pcpage **pp;
+
+  for(pp = &p->ip->pages; *pp != p; pp = &(*pp)->inext)
+    ;
+  *pp = p->inext;
+  p->ip = 0;
+}
+
+// Look for the cached page at offset off of ip.
+// Caller holds ip's lock.
+struct pcpage*
+pclookup(struct inode *ip, uint off)
+{
+  struct pcpage *p;
+
+  off = (uint)PGROUNDDOWN(off);
+  acquire(&pcache.lock);
+  for(p = ip->pages; p; p = p->inext){
+    if(p->off == off){
+      p->ref++;
+      pctouch(p);
+      release(&pcache.lock);
+      return p;
+    }
+  }
+  release(&pcache.lock);
+  return 0;
+}
+
+// Return the page at offset off of ip, reading it in if it
+// isn't cached.  Returns 0 if there is no free entry or memory.
+// Caller holds ip's lock.
+struct pcpage*
+pcget(struct inode *ip, uint off)
+{
+  struct pcpage *p;
+
+  off = (uint)PGROUNDDOWN(off);
+  if((p = pclookup(ip, off)) != 0)
+    return p;
+
+  // Not cached; recycle the least recently used free entry.
+  acquire(&pcache.lock);
+  for(p = pcache.head.prev; p != &pcache.head; p = p->prev){
+    if(p->ref == 0){
+      if(p->data == 0 && (p->data = kalloc()) == 0)
+        break;
+      if(p->ip)
+        pcunlink(p);
+      p->ip = ip;
+      p->off = off;
+      p->ref = 1;
+      p->inext = ip->pages;
+      ip->pages = p;
+      pctouch(p);
+      release(&pcache.lock);
+      ireadpage(ip, off, p->data);
+      return p;
+    }
+  }
+  release(&pcache.lock);
+  return 0;
+}
+
+// Take another reference to p.
+void
+pcdup(struct pcpage *p)
+{
+  acquire(&pcache.lock);
+  p->ref++;
+  release(&pcache.lock);
+}
+
+// Drop a reference to p.
+void
+pcput(struct pcpage *p)
+{
+  acquire(&pcache.lock);
+  if(p->ref < 1)
+    panic("pcput");
+  p->ref--;
+  release(&pcache.lock);
+}
+
+// Forget every cached page of ip.  Nobody may be using them.
+void
+pcdrop(struct inode *ip)
+{
+  acquire(&pcache.lock);
+  while(ip->pages){
+    if(ip->pages->ref != 0)
+      panic("pcdrop");
+    pcunlink(ip->pages);
+  }
+  release(&pcache.lock);
+}
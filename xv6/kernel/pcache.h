@@ -0,0 +1,14 @@
+#ifndef _PCACHE_H_
+#define _PCACHE_H_
+// Page cache entry (see pcache.c)
+struct pcpage {
+  struct inode *ip;      // inode whose page this is, or 0
+  uint off;              // file offset of the page
+  int ref;               // readers and mappings using data
+  char *data;            // the page
+  struct pcpage *inext;  // next page of ip
+  struct pcpage *prev;   // LRU list
+  struct pcpage *next;
+};
+
+#endif // _PCACHE_H_
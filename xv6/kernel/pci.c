@@ -0,0 +1,86 @@
+// PCI configuration space, through the configuration address
+// and data ports (configuration mechanism #1).  Enough to find
+// a device by class or by vendor and device id, learn where its
+// registers are and let it drive the bus.
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+#include "pci.h"
+
+#define PCI_CONFADDR 0xcf8
+#define PCI_CONFDATA 0xcfc
+#define PCI_NBUS     4     // buses to look at
+
+// Read the 32-bit configuration register at off of d.
+uint
+pciread(struct pcidev *d, int off)
+{
+  outl(PCI_CONFADDR, 0x80000000 | (d->bus << 16) | (d->dev << 11) |
+       (d->func << 8) | (off & 0xfc));
+  return inl(PCI_CONFDATA);
+}
+
+void
+pciwrite(struct pcidev *d, int off, uint v)
+{
+  outl(PCI_CONFADDR, 0x80000000 | (d->bus << 16) | (d->dev << 11) |
+       (d->func << 8) | (off & 0xfc));
+  outl(PCI_CONFDATA, v);
+}
+
+// Find the first function with the given vendor and device
+// ids, class and subclass, where -1 matches anything, and fill
+// in d.  Returns 0, or -1 if there is none.
+static int
+pciscan(struct pcidev *d, int vendor, int device, int class, int subclass)
+{
+  uint id, cl;
+  int i;
+
+  for(d->bus = 0; d->bus < PCI_NBUS; d->bus++)
+  for(d->dev = 0; d->dev < 32; d->dev++)
+  for(d->func = 0; d->func < 8; d->func++){
+    id = pciread(d, PCI_ID);
+    if((id & 0xffff) == 0xffff)
+      continue;
+    d->vendor = id & 0xffff;
+    d->device = id >> 16;
+    cl = pciread(d, PCI_CLASS);
+    d->class = cl >> 24;
+    d->subclass = cl >> 16;
+    d->progif = cl >> 8;
+    if((vendor != -1 && d->vendor != vendor) ||
+       (device != -1 && d->device != device) ||
+       (class != -1 && d->class != class) ||
+       (subclass != -1 && d->subclass != subclass))
+      continue;
+    for(i = 0; i < 6; i++)
+      d->bar[i] = pciread(d, PCI_BAR0 + 4*i);
+    d->irq = pciread(d, PCI_INTR) & 0xff;
+    return 0;
+  }
+  return -1;
+}
+
+// Find the device with the given vendor and device ids.
+int
+pcifind(int vendor, int device, struct pcidev *d)
+{
+  return pciscan(d, vendor, device, -1, -1);
+}
+
+// Find the first device of the given class and subclass.
+int
+pcifindclass(int class, int subclass, struct pcidev *d)
+{
+  return pciscan(d, -1, -1, class, subclass);
+}
+
+// Let d respond to its I/O and memory ranges and master the bus.
+void
+pcienable(struct pcidev *d)
+{
+  pciwrite(d, PCI_CMD, pciread(d, PCI_CMD) |
+           PCI_CMD_IO | PCI_CMD_MEM | PCI_CMD_BUSMASTER);
+}
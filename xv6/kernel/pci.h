@@ -0,0 +1,31 @@
+#ifndef _PCI_H_
+#define _PCI_H_
+// A PCI function, as found by pcifind.
+struct pcidev {
+  uint bus;
+  uint dev;
+  uint func;
+  ushort vendor;
+  ushort device;
+  uchar class;
+  uchar subclass;
+  uchar progif;
+  uchar irq;           // interrupt line the BIOS assigned
+  uint bar[6];         // base address registers
+};
+
+// Configuration space registers.
+#define PCI_ID        0x00
+#define PCI_CMD       0x04
+#define PCI_CLASS     0x08
+#define PCI_BAR0      0x10
+#define PCI_INTR      0x3c
+
+#define PCI_CMD_IO    0x1  // respond to I/O space accesses
+#define PCI_CMD_MEM   0x2  // respond to memory space accesses
+#define PCI_CMD_BUSMASTER 0x4
+
+#define PCI_BAR_IO    0x1  // BAR is an I/O port range
+#define PCI_BAR_IOMASK 0xfffffffc
+
+#endif // _PCI_H_
@@ -2,10 +2,12 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "memlayout.h"
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
 #include "pstat.h"
+#include "traps.h"
 
 struct {
   struct spinlock lock;
@@ -18,6 +20,13 @@ int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
+// Clock hand for page replacement: the process slot and
+// user address procvictim looks at next.
+static struct {
+  int slot;
+  uint va;
+} hand;
+
 struct pstat proc_stat;
 // Headers of each priority queue
 struct proc *q0_head = NULL;
@@ -30,6 +39,7 @@ struct proc *q3_head = NULL;
 struct proc *q3_tail = NULL;
 
 static void wakeup1(void *chan);
+static void unallocproc(struct proc *p);
 
 // helper functions for queues
 //static void dump_queues();
@@ -169,6 +179,13 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->pinned = 0;
+  memset(p->mmaps, 0, sizeof(p->mmaps));
+  p->thread = 0;
+  p->ustack = 0;
+  p->vmbusy = 0;
+  p->usedfpu = 0;
+  p->fpucpu = 0;
   proc_stat.inuse[slot_idx] = 1;
   proc_stat.pid[slot_idx] = p->pid;
   proc_stat.priority[slot_idx] = 0;
@@ -185,7 +202,7 @@ found:
 
   // Allocate kernel stack if possible.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    unallocproc(p);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -207,6 +224,22 @@ found:
   return p;
 }
 
+// Undo allocproc for an embryo p that will never run: take it
+// off the run queue and free its slot and kernel stack.
+static void
+unallocproc(struct proc *p)
+{
+  acquire(&ptable.lock);
+  remove_from_queue(&q0_head, &q0_tail, p);
+  proc_stat.inuse[p - ptable.proc] = 0;
+  if(p->kstack)
+    kfree(p->kstack);
+  p->kstack = 0;
+  p->pid = 0;
+  p->state = UNUSED;
+  release(&ptable.lock);
+}
+
 // TODO(byan23): Remove the initialization of queues.
 // Set up first user process.
 void
@@ -239,25 +272,170 @@ userinit(void)
   release(&ptable.lock);
 }
 
+// Start a kernel thread called name running fn, which must
+// never return.  It has no user memory.
+void
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kproc");
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kproc: out of memory?");
+  p->sz = 0;
+  // forkret returns to fn instead of trapret.
+  *(uint*)(p->context + 1) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+}
+
+// The process whose memory p uses: p itself, or for a thread
+// its parent, which is always the thread group leader.
+struct proc*
+procleader(struct proc *p)
+{
+  return p->thread ? p->parent : p;
+}
+
+// Does p share the memory of q?  Only looks at processes
+// whose pgdir is in use, since a free slot's may be stale.
+static int
+samevm(struct proc *p, struct proc *q)
+{
+  return p->state != UNUSED && p->state != EMBRYO && p->pgdir == q->pgdir;
+}
+
+// Keep the other threads of the current process from changing
+// its memory (growproc, mmap, clone) until vmunlock.  May sleep.
+void
+vmlock(void)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  p = procleader(proc);
+  while(p->vmbusy)
+    sleep(&p->vmbusy, &ptable.lock);
+  p->vmbusy = 1;
+  release(&ptable.lock);
+}
+
+void
+vmunlock(void)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  p = procleader(proc);
+  p->vmbusy = 0;
+  wakeup1(&p->vmbusy);
+  release(&ptable.lock);
+}
+
+// Flush this CPU's TLB for whoever asked, in tlbshootdown.
+// Interrupts must be off.
+static void
+tlbflush(void)
+{
+  uint req;
+
+  req = cpu->tlbreq;
+  lcr3(rcr3());
+  cpu->tlbdone = req;
+}
+
+// The T_TLBFLUSH interrupt.
+void
+tlbintr(void)
+{
+  tlbflush();
+}
+
+// Make every CPU that may hold TLB entries for pgdir drop them,
+// once the caller has cleared PTEs in it and before it frees
+// the pages they mapped.  A CPU running a thread of pgdir,
+// this one included, is asked by an IPI; the others load pgdir
+// afresh in switchuvm.
+// Each request takes a number from the CPU's tlbreq, and a
+// flush answers every request numbered before it started.
+void
+tlbshootdown(pde_t *pgdir)
+{
+  struct cpu *c;
+  uint want[NCPU];
+  int i;
+
+  // The scheduler sets c->proc under ptable.lock, so a CPU
+  // not found here loads pgdir after the PTEs were cleared.
+  acquire(&ptable.lock);
+  for(i = 0; i < ncpu; i++){
+    c = &cpus[i];
+    if(c->proc == 0 || c->proc->pgdir != pgdir){
+      want[i] = c->tlbdone;
+      continue;
+    }
+    want[i] = ++c->tlbreq;
+    lapicipi(c->id, T_TLBFLUSH);
+  }
+  release(&ptable.lock);
+
+  // Flush here too, and keep answering requests aimed at this
+  // CPU, in case the caller holds a lock with interrupts off.
+  for(i = 0; i < ncpu; i++){
+    while((int)(cpus[i].tlbdone - want[i]) < 0){
+      pushcli();
+      if(cpu->tlbdone != cpu->tlbreq)
+        tlbflush();
+      popcli();
+    }
+  }
+}
+
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size, or -1 on failure.
 int
 growproc(int n)
 {
   //cprintf("grow proc...\n");
-  uint sz;
-
-  sz = proc->sz;
+  struct proc *p;
+  uint sz, oldsz;
+
+  vmlock();
+  sz = oldsz = proc->sz;
+  // sz + n must not wrap around, or allocuvm and deallocuvm
+  // would take it for a shrink or a grow and quietly succeed.
+  if((n > 0 && sz + n < sz) || (n < 0 && sz + n > sz)){
+    vmunlock();
+    return -1;
+  }
   if(n > 0){
-    if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0){
+      vmunlock();
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(proc->pgdir, sz, sz + n)) == 0)
+    // Keep other CPUs from paging out the pages being freed.
+    proc->pinned++;
+    sz = deallocuvm(proc->pgdir, sz, sz + n);
+    proc->pinned--;
+    if(sz == 0){
+      vmunlock();
       return -1;
+    }
   }
-  proc->sz = sz;
+
+  // Every thread sees the new size.
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(samevm(p, proc))
+      p->sz = sz;
+  release(&ptable.lock);
+  vmunlock();
   switchuvm(proc);
-  return 0;
+  return oldsz;
 }
 
 // Create a new process copying p as the parent.
@@ -274,16 +452,24 @@ fork(void)
   if((np = allocproc()) == 0)
     return -1;
 
-  // Copy process state from p.
-  if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+  // Copy process state from p, while no thread of p is
+  // shrinking it.
+  vmlock();
+  np->pgdir = copyuvm(proc->pgdir, proc->sz);
+  np->sz = proc->sz;
+  vmunlock();
+  if(np->pgdir == 0){
+    unallocproc(np);
+    return -1;
+  }
+  if(mmapcopy(np) < 0){
+    freevm(np->pgdir);
+    unallocproc(np);
     return -1;
   }
-  np->sz = proc->sz;
   np->parent = proc;
   *np->tf = *proc->tf;
+  fpucopy(np);
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
@@ -302,6 +488,101 @@ fork(void)
   return pid;
 }
 
+// Create a thread that runs fn(arg) on the one-page user stack
+// at stack, sharing the current process's memory.  It gets
+// copies of the open file table and cwd, like a fork child.
+// Returns the thread's pid, or -1.
+int
+clone(void (*fn)(void*), void *arg, void *stack)
+{
+  int i, pid;
+  struct proc *np;
+  uint ustack[2], sp;
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  // Hold the memory steady until np is visible to growproc.
+  vmlock();
+  sp = (uint)stack + PGSIZE - sizeof(ustack);
+  ustack[0] = 0xffffffff;  // fake return PC
+  ustack[1] = (uint)arg;
+  if((uint)stack % PGSIZE != 0 || (uint)stack + PGSIZE > proc->sz ||
+     pinuvm((char*)sp, sizeof(ustack)) < 0){
+    vmunlock();
+    unallocproc(np);
+    return -1;
+  }
+  copyout(proc->pgdir, sp, ustack, sizeof(ustack));
+  unpinuvm();
+
+  np->pgdir = proc->pgdir;
+  np->sz = proc->sz;
+  np->thread = 1;
+  np->parent = procleader(proc);
+  np->ustack = stack;
+  *np->tf = *proc->tf;
+  fpucopy(np);
+  np->tf->eip = (uint)fn;
+  np->tf->esp = sp;
+
+  for(i = 0; i < NOFILE; i++)
+    if(proc->ofile[i])
+      np->ofile[i] = filedup(proc->ofile[i]);
+  np->cwd = idup(proc->cwd);
+
+  pid = np->pid;
+  safestrcpy(np->name, proc->name, sizeof(proc->name));
+  np->state = RUNNABLE;
+  vmunlock();
+  return pid;
+}
+
+// Free the slot of zombie p, but not its memory.
+// Caller holds ptable.lock.
+static void
+freeproc(struct proc *p)
+{
+  kfree(p->kstack);
+  p->kstack = 0;
+  p->state = UNUSED;
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->thread = 0;
+}
+
+// Kill the current process's threads and wait for them to exit.
+// For a thread group leader about to give up its memory.
+void
+killthreads(void)
+{
+  struct proc *p;
+  int n;
+
+  acquire(&ptable.lock);
+  for(;;){
+    n = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(!p->thread || p->parent != proc)
+        continue;
+      if(p->state == ZOMBIE){
+        freeproc(p);
+        continue;
+      }
+      p->killed = 1;
+      if(p->state == SLEEPING)
+        p->state = RUNNABLE;
+      n++;
+    }
+    if(n == 0)
+      break;
+    sleep(proc, &ptable.lock);  // see wakeup1 in exit
+  }
+  release(&ptable.lock);
+}
+
 // TODO(byan23): Set inuse[] to 0?
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
@@ -316,6 +597,13 @@ exit(void)
   if(proc == initproc)
     panic("init exiting");
 
+  // Nobody else may use the memory once the leader is gone.
+  // Write back and drop file mappings while the files are open.
+  if(!proc->thread){
+    killthreads();
+    mmapexit();
+  }
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(proc->ofile[fd]){
@@ -379,27 +667,24 @@ wait(void)
   //cprintf("wait...\n");
   struct proc *p;
   int havekids, pid;
+  pde_t *pgdir;
 
   acquire(&ptable.lock);
   for(;;){
     // Scan through table looking for zombie children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != proc)
+      if(p->parent != proc || p->thread)
 	continue;
       havekids = 1;
       if(p->state == ZOMBIE){
 	// Found one.
+	// freevm takes ptable.lock in tlbshootdown.
 	pid = p->pid;
-	kfree(p->kstack);
-	p->kstack = 0;
-	freevm(p->pgdir);
-	p->state = UNUSED;
-	p->pid = 0;
-	p->parent = 0;
-	p->name[0] = 0;
-	p->killed = 0;
+	pgdir = p->pgdir;
+	freeproc(p);
 	release(&ptable.lock);
+	freevm(pgdir);
 	return pid;
       }
     }
@@ -415,6 +700,44 @@ wait(void)
   }
 }
 
+// Wait for another thread of the current process to exit,
+// store the user stack it was cloned with in *stack, and
+// return its pid.  Return -1 if there are no other threads.
+int
+join(void **stack)
+{
+  struct proc *p, *leader;
+  int havethreads, pid;
+  void *ustack;
+
+  acquire(&ptable.lock);
+  leader = procleader(proc);
+  for(;;){
+    havethreads = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(!p->thread || p->parent != leader || p == proc)
+        continue;
+      havethreads = 1;
+      if(p->state == ZOMBIE){
+        pid = p->pid;
+        ustack = p->ustack;
+        freeproc(p);
+        release(&ptable.lock);
+        *stack = ustack;  // may fault; not holding a lock
+        return pid;
+      }
+    }
+
+    if(!havethreads || proc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+
+    // Exiting threads wake their leader.
+    sleep(leader, &ptable.lock);
+  }
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -484,6 +807,7 @@ scheduler(void)
       p->state = RUNNING;
       swtch(&cpu->scheduler, proc->context);
       switchkvm();
+      fpuswitchout(p);
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
@@ -492,6 +816,10 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    // Nothing to run: clear a free page for kalloc_zeroed.
+    if(!sched)
+      kzero();
+
   }
 }
 
@@ -744,3 +1072,51 @@ int getpinfo(struct pstat *p) {
   memmove(p->ticks, proc_stat.ticks, NPROC * 4);
   return 0;
 }
+
+// Can p's memory be paged out?  Not if p or a thread sharing
+// its memory is running on another CPU or has pinned it.
+// Caller holds ptable.lock.
+static int
+evictable(struct proc *p)
+{
+  struct proc *q;
+
+  if(p->state != SLEEPING && p->state != RUNNABLE &&
+     !(p->state == RUNNING && p == proc))
+    return 0;
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(samevm(q, p) && (q->pinned || (q->state == RUNNING && q != proc)))
+      return 0;
+  return 1;
+}
+
+// Choose a user page to page out to swap slot, sweeping the
+// clock hand through every process's address space (see
+// uvmvictim).  Only evictable processes qualify.  Returns the
+// page, already unmapped, or 0 if two sweeps found nothing.
+// Caller holds the swap lock.
+char*
+procvictim(uint slot)
+{
+  struct proc *p;
+  char *mem;
+  int n;
+
+  acquire(&ptable.lock);
+  for(n = 0; n <= 2*NPROC; n++){
+    p = &ptable.proc[hand.slot];
+    if(evictable(p)){
+      mem = uvmvictim(p->pgdir, p->sz, &hand.va, slot);
+      if(mem){
+        if(proc && p->pgdir == proc->pgdir)
+          lcr3(V2P(p->pgdir));  // flush the TLB entry
+        release(&ptable.lock);
+        return mem;
+      }
+    }
+    hand.slot = (hand.slot + 1) % NPROC;
+    hand.va = 0;
+  }
+  release(&ptable.lock);
+  return 0;
+}
@@ -23,6 +23,10 @@ struct cpu {
   // Cpu-local storage variables; see below
   struct cpu *cpu;
   struct proc *proc;           // The currently-running process.
+
+  struct proc *fpuowner;       // Whose FPU state is in the registers
+  volatile uint tlbreq;        // TLB flushes asked for; see tlbshootdown
+  volatile uint tlbdone;       // tlbreq as of the last flush
 };
 
 extern struct cpu cpus[NCPU];
@@ -57,6 +61,15 @@ struct context {
   uint eip;
 };
 
+// A file mapping (see mmap.c).
+struct vma {
+  struct inode *ip;            // Mapped file, or 0 if the slot is free
+  uint off;                    // File offset of the first page
+  int npages;                  // Pages mapped
+  int writable;                // Mapped with PROT_WRITE
+  struct pcpage *pages[MMAPMAX/PGSIZE]; // Page cache entries mapped
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -74,6 +87,14 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int pinned;                  // If non-zero, don't page out memory
+  struct vma mmaps[NMMAP];     // File mappings
+  int thread;                  // If non-zero, shares parent's memory
+  void *ustack;                // User stack passed to clone
+  int vmbusy;                  // Memory is being changed (see vmlock)
+  int usedfpu;                 // fxstate holds FPU state (see fpu.c)
+  struct cpu *fpucpu;          // CPU that last loaded fxstate
+  uchar fxstate[512] __attribute__((aligned(16))); // Saved FPU/SSE registers
   struct proc *next;	       // Ptr of the next process in the pri-queue
 };
 
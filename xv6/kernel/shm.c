@@ -0,0 +1,205 @@
+// Shared memory segments.
+//
+// A segment is a set of physical pages with a name.  Every
+// process that attaches it maps the same pages, at the same
+// user address (SHMADDR), so pointers into a segment mean the
+// same thing in each of them.  Segment addresses lie between
+// SHMBASE and USERTOP, above anything sbrk can reach.
+//
+// Interface:
+// * shmcreate(name, size) finds or makes the segment and
+//   returns its id; shmattach(id) maps it into the current
+//   process and shmdetach(addr) unmaps it.
+// * fork gives the child the parent's attachments
+//   (shmcopyuvm) and freevm drops them (shmfreevm).
+// * A segment is freed when its last attachment goes away.
+//   Until it is first attached, it stays around.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define SHMADDR(id) (SHMBASE + (id)*SHMMAX)
+
+struct shmseg {
+  int used;
+  char name[SHMNAME];
+  int npages;
+  int ref;                     // attachments
+  char *pages[SHMMAX/PGSIZE];
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+// Drop one attachment of segment id, freeing it with the last.
+static void
+shmput(int id)
+{
+  struct shmseg *s;
+  int i;
+
+  acquire(&shmtable.lock);
+  s = &shmtable.seg[id];
+  if(s->ref < 1)
+    panic("shmput");
+  if(--s->ref == 0){
+    for(i = 0; i < s->npages; i++)
+      kfree(s->pages[i]);
+    s->used = 0;
+  }
+  release(&shmtable.lock);
+}
+
+// Is segment id mapped in pgdir?
+static int
+shmmapped(pde_t *pgdir, int id)
+{
+  struct shmseg *s;
+  char *pa;
+
+  s = &shmtable.seg[id];
+  pa = uva2ka(pgdir, (char*)SHMADDR(id));
+  return pa != 0 && s->used && pa == s->pages[0];
+}
+
+// Return the id of the segment called name, creating it with
+// size bytes if there is none.  Returns -1 if the table is
+// full, there is no memory, or name exists and is smaller.
+int
+shmcreate(char *name, int size)
+{
+  struct shmseg *s, *free;
+  int i;
+
+  if(size <= 0 || size > SHMMAX)
+    return -1;
+  acquire(&shmtable.lock);
+  free = 0;
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(s->used && strncmp(s->name, name, SHMNAME) == 0){
+      release(&shmtable.lock);
+      if(s->npages*PGSIZE < size)
+        return -1;
+      return s - shmtable.seg;
+    }
+    if(!s->used && free == 0)
+      free = s;
+  }
+  if((s = free) == 0){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->npages = PGROUNDUP(size) / PGSIZE;
+  for(i = 0; i < s->npages; i++){
+    if((s->pages[i] = kalloc_zeroed()) == 0){
+      while(--i >= 0)
+        kfree(s->pages[i]);
+      release(&shmtable.lock);
+      return -1;
+    }
+  }
+  safestrcpy(s->name, name, SHMNAME);
+  s->ref = 0;
+  s->used = 1;
+  release(&shmtable.lock);
+  return s - shmtable.seg;
+}
+
+// Map segment id into the current process.  Returns its
+// address, or 0 on error.
+char*
+shmattach(int id)
+{
+  struct shmseg *s;
+
+  if(id < 0 || id >= NSHM)
+    return 0;
+  s = &shmtable.seg[id];
+  acquire(&shmtable.lock);
+  if(!s->used){
+    release(&shmtable.lock);
+    return 0;
+  }
+  if(shmmapped(proc->pgdir, id)){
+    release(&shmtable.lock);
+    return (char*)SHMADDR(id);
+  }
+  s->ref++;
+  release(&shmtable.lock);
+
+  // The pages can't go away while we hold a reference.
+  if(mapshared(proc->pgdir, SHMADDR(id), s->pages, s->npages,
+               PTE_W|PTE_U) < 0){
+    shmput(id);
+    return 0;
+  }
+  return (char*)SHMADDR(id);
+}
+
+// Unmap the segment at addr from the current process.
+int
+shmdetach(char *addr)
+{
+  int id;
+
+  if((uint)addr < SHMBASE || (uint)addr >= USERTOP)
+    return -1;
+  id = ((uint)addr - SHMBASE) / SHMMAX;
+  if((uint)addr != SHMADDR(id) || !shmmapped(proc->pgdir, id))
+    return -1;
+  unmapshared(proc->pgdir, SHMADDR(id), shmtable.seg[id].npages);
+  tlbshootdown(proc->pgdir);
+  shmput(id);
+  return 0;
+}
+
+// Attach the child page table to every segment the parent
+// page table has attached.
+int
+shmcopyuvm(pde_t *pgdir, pde_t *d)
+{
+  struct shmseg *s;
+  int id;
+
+  for(id = 0; id < NSHM; id++){
+    s = &shmtable.seg[id];
+    acquire(&shmtable.lock);
+    if(!shmmapped(pgdir, id)){
+      release(&shmtable.lock);
+      continue;
+    }
+    s->ref++;
+    release(&shmtable.lock);
+    if(mapshared(d, SHMADDR(id), s->pages, s->npages, PTE_W|PTE_U) < 0){
+      shmput(id);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Detach every segment from pgdir, which is about to be freed.
+void
+shmfreevm(pde_t *pgdir)
+{
+  int id;
+
+  for(id = 0; id < NSHM; id++){
+    if(shmmapped(pgdir, id)){
+      unmapshared(pgdir, SHMADDR(id), shmtable.seg[id].npages);
+      shmput(id);
+    }
+  }
+}
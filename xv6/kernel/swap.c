@@ -0,0 +1,146 @@
+// Swap space: page-sized slots in a reserved area of disk
+// SWAPDEV, starting at sector SWAPSTART, where vm.c puts
+// user pages when memory runs short.
+//
+// Interface:
+// * swapalloc() and swapfree() hand out and return slots.
+// * swapwrite() and swapread() move one page to or from a slot.
+//   The caller must hold the swap lock (swaplock/swapunlock),
+//   which also serializes every change that pages a PTE out
+//   or back in, so a page never moves in both directions at once.
+//
+// A paged-out PTE has PTE_P clear, PTE_SWAP set, and the slot
+// number where the physical page address would be.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "buf.h"
+#include "sysinfo.h"
+
+#define SECTPERPG (PGSIZE/512)
+
+struct {
+  struct spinlock lock;
+  int busy;              // somebody holds the swap lock
+  uchar used[NSWAP];     // slot i holds a page
+  uint nfree;            // free slots
+  uint nswapin;          // pages read back from swap
+  uint nswapout;         // pages written to swap
+  struct buf buf[SECTPERPG]; // for disk I/O; protected by busy
+} swap;
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  swap.nfree = NSWAP;
+  cprintf("swap: %d pages at sector %d of disk %d\n",
+          NSWAP, SWAPSTART, SWAPDEV);
+}
+
+// Acquire the swap lock, sleeping while another process has it.
+void
+swaplock(void)
+{
+  acquire(&swap.lock);
+  while(swap.busy)
+    sleep(&swap, &swap.lock);
+  swap.busy = 1;
+  release(&swap.lock);
+}
+
+void
+swapunlock(void)
+{
+  acquire(&swap.lock);
+  swap.busy = 0;
+  wakeup(&swap);
+  release(&swap.lock);
+}
+
+// Allocate a swap slot.  Returns -1 if swap is full.
+int
+swapalloc(void)
+{
+  int i;
+
+  acquire(&swap.lock);
+  for(i = 0; i < NSWAP; i++){
+    if(!swap.used[i]){
+      swap.used[i] = 1;
+      swap.nfree--;
+      release(&swap.lock);
+      return i;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+void
+swapfree(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= NSWAP || !swap.used[slot])
+    panic("swapfree");
+  swap.used[slot] = 0;
+  swap.nfree++;
+  release(&swap.lock);
+}
+
+// Read or write the page at mem from or to slot.  The page's
+// sectors go to the driver as one list, so it can move them
+// with a single disk command.  Caller holds the swap lock.
+static void
+swaprw(uint slot, char *mem, int write)
+{
+  struct buf *b;
+  int i;
+
+  if(!swap.busy)
+    panic("swaprw: not locked");
+  for(i = 0; i < SECTPERPG; i++){
+    b = &swap.buf[i];
+    b->dev = SWAPDEV;
+    b->sector = SWAPSTART + slot*SECTPERPG + i;
+    if(write){
+      memmove(b->data, mem + i*512, 512);
+      b->flags = B_BUSY | B_DIRTY;
+    } else
+      b->flags = B_BUSY;
+    b->rwnext = i+1 < SECTPERPG ? &swap.buf[i+1] : 0;
+  }
+  blkrw(&swap.buf[0]);
+  if(!write)
+    for(i = 0; i < SECTPERPG; i++)
+      memmove(mem + i*512, swap.buf[i].data, 512);
+}
+
+void
+swapwrite(uint slot, char *mem)
+{
+  swaprw(slot, mem, 1);
+  swap.nswapout++;
+}
+
+void
+swapread(uint slot, char *mem)
+{
+  swaprw(slot, mem, 0);
+  swap.nswapin++;
+}
+
+// Report swap totals for the sysinfo system call.
+void
+swapstat(struct sysinfo *si)
+{
+  acquire(&swap.lock);
+  si->totalswap = NSWAP * PGSIZE;
+  si->freeswap = swap.nfree * PGSIZE;
+  si->nswapin = swap.nswapin;
+  si->nswapout = swap.nswapout;
+  release(&swap.lock);
+}
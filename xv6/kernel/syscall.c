@@ -104,6 +104,22 @@ static int (*syscalls[])(void) = {
 [SYS_write]   sys_write,
 [SYS_uptime]  sys_uptime,
 [SYS_getpinfo] sys_getpinfo,
+[SYS_sysinfo] sys_sysinfo,
+[SYS_shmcreate] sys_shmcreate,
+[SYS_shmattach] sys_shmattach,
+[SYS_shmdetach] sys_shmdetach,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_bcachesize] sys_bcachesize,
+[SYS_sync]    sys_sync,
+[SYS_fsync]   sys_fsync,
+[SYS_iosched] sys_iosched,
+[SYS_mount]   sys_mount,
+[SYS_mkhashdir] sys_mkhashdir,
 };
 
 // Called on a syscall trap. Checks that the syscall number (passed via eax)
@@ -62,24 +62,33 @@ int
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   char *p;
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
     return -1;
-  return fileread(f, p, n);
+  // Pipes and the console copy with a spin lock held.
+  if(pinuvm(p, n) < 0)
+    return -1;
+  r = fileread(f, p, n);
+  unpinuvm();
+  return r;
 }
 
 int
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   char *p;
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
     return -1;
-  return filewrite(f, p, n);
+  if(pinuvm(p, n) < 0)
+    return -1;
+  r = filewrite(f, p, n);
+  unpinuvm();
+  return r;
 }
 
 int
@@ -146,16 +155,19 @@ bad:
 }
 
 // Is the directory dp empty except for "." and ".." ?
+// They are the first two entries, unless dp is hashed.
 static int
 isdirempty(struct inode *dp)
 {
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  off = dp->major == DIR_HASHED ? 0 : 2*sizeof(de);
+  for(; off<dp->size; off+=sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 &&
+       namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -198,6 +210,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcenter(dp->dev, dp->inum, name, 0, 0);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -230,7 +243,7 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0)
+  if((ip = ialloc(dp->dev, type, dp->inum)) == 0)
     panic("create: ialloc");
 
   ilock(ip);
@@ -240,6 +253,10 @@ create(char *path, short type, short major, short minor)
   iupdate(ip);
 
   if(type == T_DIR){  // Create . and .. entries.
+    if(major == DIR_HASHED){
+      dirhinit(ip);
+      iupdate(ip);
+    }
     dp->nlink++;  // for ".."
     iupdate(dp);
     // No ip->nlink++ for ".": avoid cyclic ref count.
@@ -288,6 +305,9 @@ sys_open(void)
   f->type = FD_INODE;
   f->ip = ip;
   f->off = 0;
+  f->raoff = 0;
+  f->rawin = 0;
+  f->ranext = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
   return fd;
@@ -305,6 +325,20 @@ sys_mkdir(void)
   return 0;
 }
 
+// Make a hashed directory, for a directory that will hold
+// many entries.
+int
+sys_mkhashdir(void)
+{
+  char *path;
+  struct inode *ip;
+
+  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, DIR_HASHED, 0)) == 0)
+    return -1;
+  iunlockput(ip);
+  return 0;
+}
+
 int
 sys_mknod(void)
 {
@@ -390,3 +424,95 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int off, len, prot;
+  char *addr;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 ||
+     argint(2, &len) < 0 || argint(3, &prot) < 0)
+    return -1;
+  if(off < 0 || len <= 0)
+    return -1;
+  if((addr = mmap(f, off, len, prot)) == 0)
+    return -1;
+  return (int)addr;
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  return munmap((char*)addr, len);
+}
+
+// Write every dirty block in the buffer cache to disk.
+int
+sys_sync(void)
+{
+  ireclaimwait();  // so the frees go out too
+  bsync();
+  return 0;
+}
+
+// Write the blocks of the file open as fd to disk.
+int
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  isync(f->ip);
+  iunlock(f->ip);
+  return 0;
+}
+
+// Resize the buffer cache to n buffers, or just report its
+// size if n is 0.
+int
+sys_bcachesize(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0 || n < 0)
+    return -1;
+  return bcachesize(n);
+}
+
+// Choose the disk request scheduler by name.
+int
+sys_iosched(void)
+{
+  char *name;
+
+  if(argstr(0, &name) < 0)
+    return -1;
+  return iosched(name);
+}
+
+// Mount the file system on disk dev at directory path.
+int
+sys_mount(void)
+{
+  char *path;
+  int dev;
+  struct inode *ip;
+
+  if(argstr(0, &path) < 0 || argint(1, &dev) < 0 || dev < 0)
+    return -1;
+  if((ip = namei(path)) == 0)
+    return -1;
+  if(mount(ip, dev) < 0){
+    iput(ip);
+    return -1;
+  }
+  return 0;
+}
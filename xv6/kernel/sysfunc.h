@@ -24,5 +24,21 @@ int sys_wait(void);
 int sys_write(void);
 int sys_uptime(void);
 int sys_getpinfo(void);
+int sys_sysinfo(void);
+int sys_shmcreate(void);
+int sys_shmattach(void);
+int sys_shmdetach(void);
+int sys_mmap(void);
+int sys_munmap(void);
+int sys_clone(void);
+int sys_join(void);
+int sys_futex_wait(void);
+int sys_futex_wake(void);
+int sys_bcachesize(void);
+int sys_sync(void);
+int sys_fsync(void);
+int sys_iosched(void);
+int sys_mount(void);
+int sys_mkhashdir(void);
 
 #endif // _SYSFUNC_H_
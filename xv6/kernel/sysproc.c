@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "sysfunc.h"
 #include "pstat.h"
+#include "sysinfo.h"
 
 int
 sys_fork(void)
@@ -50,8 +51,7 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = proc->sz;
-  if(growproc(n) < 0)
+  if((addr = growproc(n)) < 0)
     return -1;
   return addr;
 }
@@ -96,3 +96,95 @@ int sys_getpinfo(void) {
   if (argptr(0, (void*)&p, sizeof(struct pstat)) < 0) return -1;
   return getpinfo(p);
 }
+
+// Fill in system-wide statistics for the caller.
+int
+sys_sysinfo(void)
+{
+  struct sysinfo *si;
+
+  if(argptr(0, (void*)&si, sizeof(*si)) < 0)
+    return -1;
+  memset(si, 0, sizeof(*si));
+  kmemstat(si);
+  swapstat(si);
+  bstat(si);
+  idestat(si);
+  fsstat(si);
+  dcstat(si);
+  return 0;
+}
+
+int
+sys_shmcreate(void)
+{
+  char *name;
+  int size;
+
+  if(argstr(0, &name) < 0 || argint(1, &size) < 0)
+    return -1;
+  return shmcreate(name, size);
+}
+
+int
+sys_shmattach(void)
+{
+  int id;
+  char *addr;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  if((addr = shmattach(id)) == 0)
+    return -1;
+  return (int)addr;
+}
+
+int
+sys_shmdetach(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return shmdetach((char*)addr);
+}
+
+int
+sys_clone(void)
+{
+  int fn, arg, stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+    return -1;
+  return clone((void(*)(void*))fn, (void*)arg, (void*)stack);
+}
+
+int
+sys_join(void)
+{
+  void **stack;
+
+  if(argptr(0, (void*)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(stack);
+}
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
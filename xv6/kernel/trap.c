@@ -51,15 +51,17 @@ trap(struct trapframe *tf)
       ticks++;
       wakeup(&ticks);
       release(&tickslock);
+      idetimer();
     }
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
-    ideintr();
+    ideintr(0);
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE+1:
-    // Bochs generates spurious IDE1 interrupts.
+    ideintr(1);
+    lapiceoi();
     break;
   case T_IRQ0 + IRQ_KBD:
     kbdintr();
@@ -69,14 +71,38 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_TLBFLUSH:
+    tlbintr();
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
             cpu->id, tf->cs, tf->eip);
     lapiceoi();
     break;
-   
+
+  case T_DEVICE:
+    // First FPU instruction since the process was switched in.
+    if(proc && (tf->cs&3) == DPL_USER){
+      fputrap();
+      break;
+    }
+    panic("trap: kernel used the FPU");
+
+  case T_PGFLT:
+    // A not-present user page may just be out in swap.  From
+    // the kernel, only if no spin lock is held: paging in sleeps.
+    if(proc && (tf->err & PTE_P) == 0 && rcr2() < proc->sz &&
+       ((tf->cs&3) == DPL_USER || cpu->ncli == 0) &&
+       pagein(proc->pgdir, rcr2()) == 0)
+      break;
+    // fall through
   default:
+    if(virtiointr(tf->trapno - T_IRQ0)){
+      lapiceoi();
+      break;
+    }
     if(proc == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
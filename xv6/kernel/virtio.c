@@ -0,0 +1,346 @@
+// Virtio block device driver, for the legacy PCI interface
+// (virtio 0.9.5) that QEMU gives a -drive if=virtio disk.
+//
+// The driver and the device share one request queue, a vring:
+// a table of descriptors, each naming a piece of physical
+// memory; the avail ring, through which the driver hands the
+// device chains of descriptors; and the used ring, through
+// which the device hands them back when it is done.  A request
+// is a chain of a header (read or write, first sector), the
+// data of up to VIOMAXSECT bufs for consecutive sectors, one
+// descriptor each, and a status byte for the device to fill in.
+//
+// Unlike the IDE disk, the device takes up to NVIOREQ requests
+// at once.  A buf that comes when all of them are out, or when
+// descriptors run short, waits on vio.pending, and is merged
+// with its neighbours into one request when there is room.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "buf.h"
+#include "pci.h"
+
+// Legacy virtio registers, from the I/O port in BAR 0.
+#define VIO_FEATURES   0x00  // features the device offers
+#define VIO_GUESTFEAT  0x04  // features the driver accepts
+#define VIO_QADDR      0x08  // page number of the selected queue
+#define VIO_QSIZE      0x0c  // entries in the selected queue
+#define VIO_QSEL       0x0e  // select a queue
+#define VIO_QNOTIFY    0x10  // tell the device a queue has work
+#define VIO_STATUS     0x12
+#define VIO_ISR        0x13  // reading acknowledges the interrupt
+#define VIO_CONFIG     0x14  // virtio-blk: capacity in sectors
+
+#define VIO_ACK        0x01  // VIO_STATUS: found the device
+#define VIO_DRIVER     0x02  // VIO_STATUS: know how to drive it
+#define VIO_DRIVER_OK  0x04  // VIO_STATUS: ready
+#define VIO_FAILED     0x80  // VIO_STATUS: gave up on it
+
+struct vdesc {
+  uint64 addr;
+  uint len;
+  ushort flags;
+  ushort next;
+};
+
+#define VDESC_NEXT     1  // the chain goes on at next
+#define VDESC_WRITE    2  // the device writes this memory
+
+struct vavail {
+  ushort flags;
+  ushort idx;           // where the driver puts the next entry
+  ushort ring[];        // heads of descriptor chains
+};
+
+struct vusedelem {
+  uint id;              // head of a finished chain
+  uint len;
+};
+
+struct vused {
+  ushort flags;
+  ushort idx;           // where the device puts the next entry
+  struct vusedelem ring[];
+};
+
+// Header of a virtio-blk request.
+struct vioblkhdr {
+  uint type;
+  uint ioprio;
+  uint64 sector;
+};
+
+#define VIO_BLK_IN     0  // read
+#define VIO_BLK_OUT    1  // write
+
+#define VIOQMAX      256  // largest queue there is room for
+#define NVIOREQ       32  // requests on the device at once
+#define VIOMAXSECT    64  // most bufs in one request
+
+// Descriptors, then the avail ring, then the used ring on the
+// next page boundary.
+#define VRINGSIZE(n) \
+  (PGROUNDUP(16*(n) + 6 + 2*(n)) + PGROUNDUP(6 + 8*(n)))
+
+static uchar vioring[VRINGSIZE(VIOQMAX)] __attribute__((aligned(PGSIZE)));
+
+struct vioreq {
+  struct vioblkhdr hdr;
+  uchar status;
+  struct buf *b;        // first of its bufs, through qnext; 0 if free
+};
+
+static struct {
+  struct spinlock lock;
+  uint port;            // 0 if there is no virtio disk
+  int irq;
+  int qsize;
+  struct vdesc *desc;
+  struct vavail *avail;
+  struct vused *used;
+  int freehead;         // free descriptors, through next
+  int nfree;
+  ushort usedidx;       // used ring entries handled so far
+  struct vioreq req[NVIOREQ];
+  struct vioreq *reqof[VIOQMAX];  // request by head descriptor
+  struct buf *pending;  // bufs waiting for a request
+} vio;
+
+// Look for a virtio block device and set up its request queue.
+// Returns 0, or -1 if there is none.
+int
+virtioinit(void)
+{
+  struct pcidev d;
+  uint used;
+  int i;
+
+  if(pcifind(0x1af4, 0x1001, &d) < 0 || !(d.bar[0] & PCI_BAR_IO))
+    return -1;
+  pcienable(&d);
+  vio.port = d.bar[0] & PCI_BAR_IOMASK;
+  outb(vio.port + VIO_STATUS, 0);  // reset
+  outb(vio.port + VIO_STATUS, VIO_ACK);
+  outb(vio.port + VIO_STATUS, VIO_ACK | VIO_DRIVER);
+  inl(vio.port + VIO_FEATURES);
+  outl(vio.port + VIO_GUESTFEAT, 0);  // no optional features
+
+  outw(vio.port + VIO_QSEL, 0);
+  vio.qsize = inw(vio.port + VIO_QSIZE);
+  if(vio.qsize == 0 || vio.qsize > VIOQMAX){
+    cprintf("virtio: can't use a queue of %d\n", vio.qsize);
+    outb(vio.port + VIO_STATUS, VIO_FAILED);
+    vio.port = 0;
+    return -1;
+  }
+  used = PGROUNDUP(16*vio.qsize + 6 + 2*vio.qsize);
+  vio.desc = (struct vdesc*)vioring;
+  vio.avail = (struct vavail*)(vioring + 16*vio.qsize);
+  vio.used = (struct vused*)(vioring + used);
+  for(i = 0; i < vio.qsize; i++)
+    vio.desc[i].next = i + 1;
+  vio.freehead = 0;
+  vio.nfree = vio.qsize;
+
+  initlock(&vio.lock, "virtio");
+  outl(vio.port + VIO_QADDR, V2P(vioring) >> PGSHIFT);
+  outb(vio.port + VIO_STATUS, VIO_ACK | VIO_DRIVER | VIO_DRIVER_OK);
+  bdevsw[VIRTIODEV].rw = virtiorw;
+  bdevsw[VIRTIODEV].nsect = inl(vio.port + VIO_CONFIG);
+
+  vio.irq = d.irq;
+  picenable(vio.irq);
+  ioapicenable(vio.irq, ncpu - 1);
+  cprintf("virtio: disk of %d sectors at port 0x%x irq %d\n",
+          bdevsw[VIRTIODEV].nsect, vio.port, vio.irq);
+  return 0;
+}
+
+// Take a free descriptor and point it at len bytes at physical
+// address pa.  Caller must hold vio.lock and know one is free.
+static int
+viodesc(uint pa, uint len, int flags)
+{
+  int i;
+
+  i = vio.freehead;
+  vio.freehead = vio.desc[i].next;
+  vio.nfree--;
+  vio.desc[i].addr = pa;
+  vio.desc[i].len = len;
+  vio.desc[i].flags = flags;
+  return i;
+}
+
+// Turn pending bufs into requests while there are free request
+// slots and descriptors, and tell the device.  Caller must hold
+// vio.lock.
+static void
+viostart(void)
+{
+  struct vioreq *r;
+  struct buf **pp, *b, *nb, *last;
+  int head, prev, d, n, kick;
+
+  kick = 0;
+  while(vio.pending && vio.nfree >= 3){
+    for(r = vio.req; r < &vio.req[NVIOREQ]; r++)
+      if(r->b == 0)
+        break;
+    if(r == &vio.req[NVIOREQ])
+      break;
+
+    // Line up the pending bufs for b->sector+1, b->sector+2, ...
+    // behind b.
+    b = vio.pending;
+    vio.pending = b->qnext;
+    last = b;
+    for(n = 1; n < VIOMAXSECT && n + 2 < vio.nfree; n++){
+      for(pp = &vio.pending; *pp; pp = &(*pp)->qnext){
+        nb = *pp;
+        if(nb->sector == last->sector + 1 &&
+           (nb->flags & B_DIRTY) == (b->flags & B_DIRTY))
+          break;
+      }
+      if(*pp == 0)
+        break;
+      *pp = nb->qnext;
+      last->qnext = nb;
+      last = nb;
+    }
+    last->qnext = 0;
+
+    r->b = b;
+    r->hdr.type = (b->flags & B_DIRTY) ? VIO_BLK_OUT : VIO_BLK_IN;
+    r->hdr.ioprio = 0;
+    r->hdr.sector = b->sector;
+    r->status = 0xff;
+    head = prev = viodesc(V2P(&r->hdr), sizeof(r->hdr), 0);
+    for(nb = b; nb; nb = nb->qnext){
+      d = viodesc(V2P(nb->data), 512,
+                  (nb->flags & B_DIRTY) ? 0 : VDESC_WRITE);
+      vio.desc[prev].flags |= VDESC_NEXT;
+      vio.desc[prev].next = d;
+      prev = d;
+    }
+    d = viodesc(V2P(&r->status), 1, VDESC_WRITE);
+    vio.desc[prev].flags |= VDESC_NEXT;
+    vio.desc[prev].next = d;
+
+    vio.reqof[head] = r;
+    vio.avail->ring[vio.avail->idx % vio.qsize] = head;
+    __sync_synchronize();  // the device must see the chain first
+    vio.avail->idx++;
+    kick = 1;
+  }
+  if(kick){
+    __sync_synchronize();
+    outw(vio.port + VIO_QNOTIFY, 0);
+  }
+}
+
+// Interrupt handler, for any interrupt on line irq.  Returns 1
+// if the line is the disk's, 0 if not.
+int
+virtiointr(int irq)
+{
+  struct vioreq *r;
+  struct buf *b, *nb, *async;
+  int d, next, flags;
+
+  if(vio.port == 0 || irq != vio.irq)
+    return 0;
+
+  acquire(&vio.lock);
+  inb(vio.port + VIO_ISR);
+  async = 0;
+  while(vio.usedidx != *(volatile ushort*)&vio.used->idx){
+    __sync_synchronize();
+    d = vio.used->ring[vio.usedidx % vio.qsize].id;
+    vio.usedidx++;
+    r = vio.reqof[d];
+    if(r->status != 0)
+      panic("virtio: disk error");
+
+    // Give the chain back.
+    for(;;){
+      flags = vio.desc[d].flags;
+      next = vio.desc[d].next;
+      vio.desc[d].next = vio.freehead;
+      vio.freehead = d;
+      vio.nfree++;
+      if(!(flags & VDESC_NEXT))
+        break;
+      d = next;
+    }
+
+    for(b = r->b; b; b = nb){
+      nb = b->qnext;
+      b->flags |= B_VALID;
+      b->flags &= ~B_DIRTY;
+      wakeup(b);
+      if(b->flags & B_ASYNC){
+        b->qnext = async;
+        async = b;
+      }
+    }
+    r->b = 0;
+  }
+  viostart();
+  release(&vio.lock);
+
+  // Nobody is waiting for the asynchronous requests: give their
+  // buffers back to the cache.
+  while((b = async) != 0){
+    async = b->qnext;
+    b->flags &= ~B_ASYNC;
+    brelse(b);
+  }
+  return 1;
+}
+
+// Sync buf, and the bufs on its rwnext list, with the virtio
+// disk, like iderw.
+void
+virtiorw(struct buf *list)
+{
+  struct buf **pp, *b;
+
+  if(vio.port == 0)
+    panic("virtiorw: no virtio disk");
+  for(b = list; b; b = b->rwnext){
+    if(!(b->flags & B_BUSY))
+      panic("virtiorw: buf not busy");
+    if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+      panic("virtiorw: nothing to do");
+    if(b->dev != list->dev || (b->flags & B_ASYNC) != (list->flags & B_ASYNC))
+      panic("virtiorw: mixed list");
+  }
+
+  acquire(&vio.lock);
+  for(pp = &vio.pending; *pp; pp = &(*pp)->qnext)
+    ;
+  for(b = list; b; b = b->rwnext){
+    b->qnext = 0;
+    *pp = b;
+    pp = &b->qnext;
+  }
+  viostart();
+
+  // Don't wait for an asynchronous request.
+  if(list->flags & B_ASYNC){
+    release(&vio.lock);
+    return;
+  }
+
+  for(b = list; b; b = b->rwnext)
+    while((b->flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(b, &vio.lock);
+  release(&vio.lock);
+}
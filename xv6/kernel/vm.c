@@ -3,6 +3,7 @@
 #include "defs.h"
 #include "x86.h"
 #include "mmu.h"
+#include "memlayout.h"
 #include "proc.h"
 #include "elf.h"
 
@@ -10,14 +11,6 @@ extern char data[];  // defined in data.S
 
 static pde_t *kpgdir;  // for use in scheduler()
 
-// Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
-void
-kvmalloc(void)
-{
-  kpgdir = setupkvm();
-}
-
 // Set up CPU's kernel segment descriptors.
 // Run once at boot time on each CPU.
 void
@@ -46,6 +39,45 @@ seginit(void)
   proc = 0;
 }
 
+// Page out one cold user page, chosen by procvictim, to free
+// memory.  Caller holds the swap lock.  Returns 0 if no page
+// could be paged out.
+static int
+pageout(void)
+{
+  int slot;
+  char *mem;
+
+  if((slot = swapalloc()) < 0)
+    return 0;
+  if((mem = procvictim(slot)) == 0){
+    swapfree(slot);
+    return 0;
+  }
+  futexevict(V2P(mem));
+  swapwrite(slot, mem);
+  kfree(mem);
+  return 1;
+}
+
+// Allocate a page for user memory, zeroed if zero is set,
+// paging out other user memory if there is none free.
+static char*
+kallocuser(int zero)
+{
+  char *mem;
+  int ok;
+
+  while((mem = zero ? kalloc_zeroed() : kalloc()) == 0){
+    swaplock();
+    ok = pageout();
+    swapunlock();
+    if(!ok)
+      return 0;
+  }
+  return mem;
+}
+
 // Return the address of the PTE in page table pgdir
 // that corresponds to linear address va.  If create!=0,
 // create any required page table pages.
@@ -56,17 +88,18 @@ walkpgdir(pde_t *pgdir, const void *va, int create)
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    panic("walkpgdir: 4MB page");
   if(*pde & PTE_P){
-    pgtab = (pte_t*)PTE_ADDR(*pde);
+    pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!create || (pgtab = (pte_t*)kalloc()) == 0)
+    // kallocuser(1) makes sure all those PTE_P bits are zero.
+    if(!create || (pgtab = (pte_t*)kallocuser(1)) == 0)
       return 0;
-    // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table 
     // entries, if necessary.
-    *pde = PADDR(pgtab) | PTE_P | PTE_W | PTE_U;
+    *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
   }
   return &pgtab[PTX(va)];
 }
@@ -97,37 +130,64 @@ mappages(pde_t *pgdir, void *la, uint size, uint pa, int perm)
   return 0;
 }
 
-// The mappings from logical to linear are one to one (i.e.,
-// segmentation doesn't do anything).
+// Map kernel addresses [la, la+size) to physical addresses
+// starting at pa.  Wherever a whole 4MB-aligned chunk fits, map it
+// with a single 4MB page (PTE_PS) instead of a page table.
+// la, pa and size must be page-aligned; la+size may wrap to 0.
+static int
+mapkpages(pde_t *pgdir, char *la, uint size, uint pa, int perm)
+{
+  char *a, *e;
+
+  for(a = la, e = la + size; a != e; ){
+    if((uint)a % PTSIZE == 0 && pa % PTSIZE == 0 &&
+       (uint)(e - a) >= PTSIZE){
+      if(pgdir[PDX(a)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(a)] = pa | perm | PTE_P | PTE_PS;
+      a += PTSIZE;
+      pa += PTSIZE;
+    } else {
+      if(mappages(pgdir, a, PGSIZE, pa, perm) < 0)
+        return -1;
+      a += PGSIZE;
+      pa += PGSIZE;
+    }
+  }
+  return 0;
+}
+
 // There is one page table per process, plus one that's used
 // when a CPU is not running any process (kpgdir).
 // A user process uses the same page table as the kernel; the
 // page protection bits prevent it from using anything other
 // than its memory.
 // 
-// setupkvm() and exec() set up every page table like this:
-//   0..640K          : user memory (text, data, stack, heap)
-//   640K..1M         : mapped direct (for IO space)
-//   1M..end          : mapped direct (for the kernel's text and data)
-//   end..PHYSTOP     : mapped direct (kernel heap and user pages)
-//   0xfe000000..0    : mapped direct (devices such as ioapic)
+// Every page table maps the kernel like this (see memlayout.h):
+//   0..KERNBASE          : user memory (text, data, stack, heap)
+//   KERNBASE..KERNLINK   : first 1MB of phys mem (for IO space)
+//   KERNLINK..data       : kernel's text and rodata, read-only
+//   data..KERNBASE+PHYSTOP : kernel data, then all of phys mem
+//                          (kernel heap and user pages)
+//   DEVSPACE..0          : mapped direct (devices such as ioapic)
 //
 // The kernel allocates memory for its heap and for user memory
-// between kernend and the end of physical memory (PHYSTOP).
-// The virtual address space of each user program includes the kernel
-// (which is inaccessible in user mode).  The user program addresses
-// range from 0 till 640KB (USERTOP), which where the I/O hole starts
-// (both in physical memory and in the kernel's virtual address
-// space).
+// between end and the top of RAM (phystop, as found by kinit1
+// from the boot loader's memory map), and uses P2V to reach it.
+// The kernel half is built once, in kpgdir, with 4MB pages for
+// almost all of it; setupkvm copies kpgdir's page directory
+// entries for that half, so all page tables share the kernel's
+// page table pages and freevm frees only the user half.
 static struct kmap {
-  void *p;
-  void *e;
+  void *virt;
+  uint phys_start;
+  uint phys_end;
   int perm;
 } kmap[] = {
-  {(void*)USERTOP,    (void*)0x100000, PTE_W},  // I/O space
-  {(void*)0x100000,   data,            0    },  // kernel text, rodata
-  {data,              (void*)PHYSTOP,  PTE_W},  // kernel data, memory
-  {(void*)0xFE000000, 0,               PTE_W},  // device mappings
+  {(void*)KERNBASE, 0,             EXTMEM,    PTE_W},  // I/O space
+  {(void*)KERNLINK, V2P(KERNLINK), V2P(data), 0    },  // kernel text, rodata
+  {(void*)data,     V2P(data),     PHYSTOP,   PTE_W},  // kernel data, memory
+  {(void*)DEVSPACE, DEVSPACE,      0,         PTE_W},  // device mappings
 };
 
 // Set up kernel part of a page table.
@@ -135,29 +195,28 @@ pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  k = kmap;
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->p, k->e - k->p, (uint)k->p, k->perm) < 0)
-      return 0;
-
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
-// Turn on paging.
+// Allocate one page table for the machine for the kernel address
+// space for scheduler processes, and switch to it.
 void
-vmenable(void)
+kvmalloc(void)
 {
-  uint cr0;
+  struct kmap *k;
 
-  switchkvm(); // load kpgdir into cr3
-  cr0 = rcr0();
-  cr0 |= CR0_PG;
-  lcr0(cr0);
+  if((kpgdir = (pde_t*)kalloc_zeroed()) == 0)
+    panic("kvmalloc");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(mapkpages(kpgdir, k->virt, k->phys_end - k->phys_start,
+                 k->phys_start, k->perm) < 0)
+      panic("kvmalloc");
+  switchkvm();
 }
 
 // Switch h/w page table register to the kernel-only page table,
@@ -165,7 +224,7 @@ vmenable(void)
 void
 switchkvm(void)
 {
-  lcr3(PADDR(kpgdir));   // switch to the kernel page table
+  lcr3(V2P(kpgdir));   // switch to the kernel page table
 }
 
 // Switch TSS and h/w page table to correspond to process p.
@@ -180,7 +239,7 @@ switchuvm(struct proc *p)
   ltr(SEG_TSS << 3);
   if(p->pgdir == 0)
     panic("switchuvm: no pgdir");
-  lcr3(PADDR(p->pgdir));  // switch to new address space
+  lcr3(V2P(p->pgdir));  // switch to new address space
   popcli();
 }
 
@@ -193,9 +252,8 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
-  mappages(pgdir, 0, PGSIZE, PADDR(mem), PTE_W|PTE_U);
+  mem = kalloc_zeroed();
+  mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
@@ -217,12 +275,106 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
       n = sz - i;
     else
       n = PGSIZE;
-    if(readi(ip, (char*)pa, offset+i, n) != n)
+    if(readi(ip, P2V(pa), offset+i, n) != n)
+      return -1;
+  }
+  return 0;
+}
+
+// Clock (second chance) scan for a page to page out of pgdir,
+// from user address *va up to sz.  A page whose accessed bit
+// is set gets the bit cleared and is passed over; the first one
+// with it clear is marked as paged out to slot and returned,
+// with *va set just past it.  Returns 0, with *va >= sz, if the
+// scan reaches sz.  The caller makes sure no CPU is running
+// with pgdir loaded and holds the swap lock.
+char*
+uvmvictim(pde_t *pgdir, uint sz, uint *va, uint slot)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDUP(*va); a < sz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;  // skip missing page table
+      continue;
+    }
+    if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+      continue;
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      continue;
+    }
+    *va = a + PGSIZE;
+    a = PTE_ADDR(*pte);
+    *pte = (slot << PTXSHIFT) | (*pte & (PTE_W|PTE_U)) | PTE_SWAP;
+    return P2V(a);
+  }
+  *va = sz;
+  return 0;
+}
+
+// Bring the page at user address va of pgdir back in from swap.
+// Returns 0 if the page is present when it returns, -1 if va is
+// not a paged-out page or there is no memory for it.
+int
+pagein(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem;
+  uint slot;
+  int r;
+
+  swaplock();
+  r = -1;
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_P))
+    r = 0;
+  else if(pte && (*pte & PTE_SWAP)){
+    while((mem = kalloc()) == 0 && pageout())
+      ;
+    if(mem){
+      slot = PTE_ADDR(*pte) >> PTXSHIFT;
+      swapread(slot, mem);
+      swapfree(slot);
+      *pte = V2P(mem) | (*pte & (PTE_W|PTE_U)) | PTE_P;
+      r = 0;
+    }
+  }
+  swapunlock();
+  return r;
+}
+
+// Keep the current process's memory from being paged out, after
+// bringing in [uva, uva+n), until unpinuvm.  For system calls
+// that copy to or from user memory with a spin lock held, where
+// a page fault could not sleep waiting for the disk.
+int
+pinuvm(char *uva, uint n)
+{
+  pte_t *pte;
+  uint a;
+
+  proc->pinned++;
+  for(a = (uint)PGROUNDDOWN(uva); a < (uint)uva + n; a += PGSIZE){
+    pte = walkpgdir(proc->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P))
+      continue;
+    if(pagein(proc->pgdir, a) < 0){
+      proc->pinned--;
       return -1;
+    }
   }
   return 0;
 }
 
+void
+unpinuvm(void)
+{
+  proc->pinned--;
+}
+
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -231,21 +383,24 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz > USERTOP)
+  if(newsz > MMAPBASE)
     return 0;
   if(newsz < oldsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kallocuser(1);
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
-    mappages(pgdir, (char*)a, PGSIZE, PADDR(mem), PTE_W|PTE_U);
+    if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+      kfree(mem);
+      deallocuvm(pgdir, newsz, oldsz);
+      return 0;
+    }
   }
   return newsz;
 }
@@ -263,14 +418,32 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   if(newsz >= oldsz)
     return oldsz;
 
+  // Unmap the pages first, keeping their addresses in the PTEs,
+  // and free them only once no CPU can still reach them through
+  // its TLB: threads sharing pgdir may be running elsewhere.
+  a = PGROUNDUP(newsz);
+  for(; a  < oldsz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;  // skip missing page table
+    else
+      *pte &= ~PTE_P;
+  }
+  tlbshootdown(pgdir);
+
   a = PGROUNDUP(newsz);
   for(; a  < oldsz; a += PGSIZE){
     pte = walkpgdir(pgdir, (char*)a, 0);
-    if(pte && (*pte & PTE_P) != 0){
+    if(!pte)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;  // skip missing page table
+    else if(*pte & PTE_SWAP){
+      swapfree(PTE_ADDR(*pte) >> PTXSHIFT);
+      *pte = 0;
+    } else if(*pte != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
-      kfree((char*)pa);
+      kfree(P2V(pa));
       *pte = 0;
     }
   }
@@ -286,10 +459,11 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
+  shmfreevm(pgdir);
   deallocuvm(pgdir, USERTOP, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(USERTOP); i++){
     if(pgdir[i] & PTE_P)
-      kfree((char*)PTE_ADDR(pgdir[i]));
+      kfree(P2V(PTE_ADDR(pgdir[i])));
   }
   kfree((char*)pgdir);
 }
@@ -309,15 +483,26 @@ copyuvm(pde_t *pgdir, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void*)i, 0)) == 0)
       panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
+    if(!(*pte & (PTE_P|PTE_SWAP)))
       panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    if((mem = kalloc()) == 0)
+    // Allocating may page out the very page to copy, so look
+    // at the PTE only afterwards, with the swap lock held.
+    if((mem = kallocuser(0)) == 0)
       goto bad;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, PADDR(mem), PTE_W|PTE_U) < 0)
+    swaplock();
+    pa = PTE_ADDR(*pte);
+    if(*pte & PTE_P)
+      memmove(mem, (char*)P2V(pa), PGSIZE);
+    else
+      swapread(pa >> PTXSHIFT, mem);
+    swapunlock();
+    if(mappages(d, (void*)i, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+      kfree(mem);
       goto bad;
+    }
   }
+  if(shmcopyuvm(pgdir, d) < 0)
+    goto bad;
   return d;
 
 bad:
@@ -325,18 +510,63 @@ bad:
   return 0;
 }
 
-// Map user virtual address to kernel physical address.
+// Map the n pages in pages[] at user address va with
+// permissions perm.  The pages belong to somebody else (shared
+// memory segments, the page cache), which must unmap them
+// again before freevm frees the rest of the address space.
+int
+mapshared(pde_t *pgdir, uint va, char **pages, int n, int perm)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(mappages(pgdir, (char*)va + i*PGSIZE, PGSIZE, V2P(pages[i]),
+                perm) < 0){
+      unmapshared(pgdir, va, i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Has the page at user address va been written since it
+// was mapped?
+int
+uvmdirty(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  return pte != 0 && (*pte & PTE_P) && (*pte & PTE_D);
+}
+
+// Remove the n pages at user address va from pgdir without
+// freeing them.
+void
+unmapshared(pde_t *pgdir, uint va, int n)
+{
+  pte_t *pte;
+  int i;
+
+  for(i = 0; i < n; i++)
+    if((pte = walkpgdir(pgdir, (char*)va + i*PGSIZE, 0)) != 0)
+      *pte = 0;
+}
+
+// Map user virtual address to kernel address.
 char*
 uva2ka(pde_t *pgdir, char *uva)
 {
   pte_t *pte;
 
+  if((uint)uva >= USERTOP)
+    return 0;
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  return (char*)PTE_ADDR(*pte);
+  return (char*)P2V(PTE_ADDR(*pte));
 }
 
 // Copy len bytes from p to user address va in page table pgdir.
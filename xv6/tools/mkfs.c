@@ -18,10 +18,11 @@
 #undef dirent
 
 #define BLOCK_SIZE (512)
+#define NDPB (BLOCK_SIZE / sizeof(struct xv6_dirent))  // dirents per block
 
-int nblocks = 995;
+int nblocks = 16351;
 int ninodes = 200;
-int size = 1024;
+int size = 16384;
 
 int fsfd;
 struct superblock sb;
@@ -31,6 +32,7 @@ uint usedblocks;
 uint bitblocks;
 uint freeinode = 1;
 uint root_inode;
+int hashroot;  // -h: make the root a hashed directory
 
 void balloc(int);
 void wsect(uint, void*);
@@ -39,6 +41,8 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+uint dirialloc(int hashed);
+void dirappend(uint inum, struct xv6_dirent *de);
 
 // convert to intel byte order
 ushort
@@ -111,12 +115,12 @@ add_dir(DIR *cur_dir, int cur_inode, int parent_inode) {
 	bzero(&de, sizeof(de));
 	de.inum = xshort(cur_inode);
 	strcpy(de.name, ".");
-	iappend(cur_inode, &de, sizeof(de));
+	dirappend(cur_inode, &de);
 
 	bzero(&de, sizeof(de));
 	de.inum = xshort(parent_inode);
 	strcpy(de.name, "..");
-	iappend(cur_inode, &de, sizeof(de));
+	dirappend(cur_inode, &de);
 
 	if (cur_dir == NULL) {
 		return 0;
@@ -162,7 +166,7 @@ add_dir(DIR *cur_dir, int cur_inode, int parent_inode) {
 		}
 
 		if (S_ISDIR(st.st_mode)) {
-      child_inode = ialloc(T_DIR);
+      child_inode = dirialloc(0);
 			r = add_dir(fdopendir(child_fd), child_inode, cur_inode);
 			if (r != 0) return r;
 			if (fchdir(cur_fd) != 0) {
@@ -181,12 +185,14 @@ add_dir(DIR *cur_dir, int cur_inode, int parent_inode) {
 
 		de.inum = xshort(child_inode);
 		strncpy(de.name, entry->d_name, DIRSIZ);
-		iappend(cur_inode, &de, sizeof(de));
+		dirappend(cur_inode, &de);
 
 	}
 
 	// fix size of inode cur_dir
 	rinode(cur_inode, &din);
+	if (xshort(din.major) == DIR_HASHED)
+		return 0;
 	off = xint(din.size);
 	off = ((off/BSIZE) + 1) * BSIZE;
 	din.size = xint(off);
@@ -203,13 +209,19 @@ main(int argc, char *argv[])
   int r;
   DIR *root_dir;
 
+  if(argc > 1 && strcmp(argv[1], "-h") == 0){
+    hashroot = 1;
+    argc--;
+    argv++;
+  }
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-h] fs.img files...\n");
     exit(1);
   }
 
   assert((512 % sizeof(struct dinode)) == 0);
   assert((512 % sizeof(struct xv6_dirent)) == 0);
+  assert(sizeof(struct dirhhdr) <= NDPB * DIRSIZ);
 
   fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0){
@@ -217,11 +229,11 @@ main(int argc, char *argv[])
     exit(1);
   }
 
-  mkfs(995, 200, 1024);
+  mkfs(nblocks, ninodes, size);
 
   root_dir = opendir(argv[2]);
 
-  root_inode = ialloc(T_DIR);
+  root_inode = dirialloc(hashroot);
   assert(root_inode == ROOTINO);
 
   r = add_dir(root_dir, root_inode, root_inode);
@@ -373,3 +385,147 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Same as dirhash in kernel/fs.c.
+uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return h;
+}
+
+// Disk block holding block fbn of inode inum.
+uint
+fbmap(uint inum, uint fbn)
+{
+  struct dinode din;
+  uint indirect[NINDIRECT];
+
+  rinode(inum, &din);
+  if(fbn < NDIRECT)
+    return xint(din.addrs[fbn]);
+  rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
+  return xint(indirect[fbn - NDIRECT]);
+}
+
+// Read and write the header of hashed directory inum, kept in
+// the name fields of block 0's dirent slots.
+void
+hdread(uint inum, struct dirhhdr *hd)
+{
+  struct xv6_dirent ents[NDPB];
+  uchar *p, *end;
+  int i;
+
+  rsect(fbmap(inum, 0), ents);
+  end = (uchar*)(hd + 1);
+  for(p = (uchar*)hd, i = 0; p < end; p += DIRSIZ, i++)
+    memmove(p, ents[i].name, min(DIRSIZ, end - p));
+}
+
+void
+hdwrite(uint inum, struct dirhhdr *hd)
+{
+  struct xv6_dirent ents[NDPB];
+  uchar *p, *end;
+  int i;
+
+  bzero(ents, sizeof(ents));
+  end = (uchar*)(hd + 1);
+  for(p = (uchar*)hd, i = 0; p < end; p += DIRSIZ, i++)
+    memmove(ents[i].name, p, min(DIRSIZ, end - p));
+  wsect(fbmap(inum, 0), ents);
+}
+
+// Allocate a directory inode; a hashed one if hashed, with a
+// header and one empty block.
+uint
+dirialloc(int hashed)
+{
+  uint inum;
+  struct dinode din;
+  struct dirhhdr hd;
+
+  inum = ialloc(T_DIR);
+  if(hashed){
+    rinode(inum, &din);
+    din.major = xshort(DIR_HASHED);
+    winode(inum, &din);
+    iappend(inum, zeroes, sizeof(zeroes));
+    iappend(inum, zeroes, sizeof(zeroes));
+    bzero(&hd, sizeof(hd));
+    hd.table[0] = 1;
+    hdwrite(inum, &hd);
+  }
+  return inum;
+}
+
+// Add de to directory inum: at the end of a plain one, or
+// where the kernel's dirlink would put it in a hashed one,
+// splitting full blocks the same way.
+void
+dirappend(uint inum, struct xv6_dirent *de)
+{
+  struct dinode din;
+  struct dirhhdr hd;
+  struct xv6_dirent ents[NDPB], nents[NDPB];
+  uint h, b, nb, ld, i, j, k, sec, nsec;
+
+  rinode(inum, &din);
+  if(xshort(din.major) != DIR_HASHED){
+    iappend(inum, de, sizeof(*de));
+    return;
+  }
+  h = dirhash(de->name);
+  for(;;){
+    hdread(inum, &hd);
+    b = hd.table[h & ((1 << hd.depth) - 1)];
+    sec = fbmap(inum, b);
+    rsect(sec, ents);
+    for(j = 0; j < NDPB; j++){
+      if(ents[j].inum == 0){
+        ents[j] = *de;
+        wsect(sec, ents);
+        return;
+      }
+    }
+
+    // Split block b.
+    rinode(inum, &din);
+    nb = xint(din.size) / BLOCK_SIZE;
+    ld = hd.ldepth[b];
+    if(ld == DIRHDEPTH || nb == MAXFILE){
+      fprintf(stderr, "mkfs: directory full\n");
+      exit(1);
+    }
+    if(ld == hd.depth){
+      for(i = 0; i < (1 << hd.depth); i++)
+        hd.table[i + (1 << hd.depth)] = hd.table[i];
+      hd.depth++;
+    }
+    iappend(inum, zeroes, sizeof(zeroes));
+    hd.ldepth[b] = hd.ldepth[nb] = ld + 1;
+    for(i = 0; i < (1 << hd.depth); i++)
+      if(hd.table[i] == b && ((i >> ld) & 1))
+        hd.table[i] = nb;
+    bzero(nents, sizeof(nents));
+    for(j = 0, k = 0; j < NDPB; j++){
+      if((dirhash(ents[j].name) >> ld) & 1){
+        nents[k++] = ents[j];
+        bzero(&ents[j], sizeof(ents[j]));
+      }
+    }
+    nsec = fbmap(inum, nb);
+    wsect(sec, ents);
+    wsect(nsec, nents);
+    hdwrite(inum, &hd);
+  }
+}
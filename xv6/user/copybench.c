@@ -0,0 +1,106 @@
+// A large sequential copy, and what it costs the CPU.  Copies
+// NFILE files of FILESZ bytes, read from disk with the buffer
+// cache emptied first and written back with sync, and reports
+// the throughput and the share of one CPU's cycles the disk
+// driver used.  Build the kernel with IDEDMA 0 to compare PIO.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "sysinfo.h"
+#include "x86.h"
+
+#define NFILE  16
+#define FILESZ (64*1024)
+#define CHUNK  4096
+
+char buf[CHUNK];
+
+void
+filename(char *name, char c, int i)
+{
+  name[0] = 'c';
+  name[1] = c;
+  name[2] = '0' + i/10;
+  name[3] = '0' + i%10;
+  name[4] = 0;
+}
+
+void
+copy(char *from, char *to)
+{
+  int fd0, fd1, n;
+
+  fd0 = open(from, O_RDONLY);
+  fd1 = open(to, O_CREATE|O_RDWR);
+  if(fd0 < 0 || fd1 < 0){
+    printf(1, "copybench: open failed\n");
+    exit();
+  }
+  while((n = read(fd0, buf, CHUNK)) > 0){
+    if(write(fd1, buf, n) != n){
+      printf(1, "copybench: write failed\n");
+      exit();
+    }
+  }
+  close(fd0);
+  close(fd1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo before, after;
+  char from[5], to[5];
+  int i, fd, nbuf, t;
+  uint64 c;
+  uint kc;
+
+  memset(buf, 'c', CHUNK);
+  for(i = 0; i < NFILE; i++){
+    filename(from, 's', i);
+    if((fd = open(from, O_CREATE|O_RDWR)) < 0){
+      printf(1, "copybench: create failed\n");
+      exit();
+    }
+    for(t = 0; t < FILESZ; t += CHUNK)
+      write(fd, buf, CHUNK);
+    close(fd);
+  }
+  // Empty the buffer cache.
+  sync();
+  nbuf = bcachesize(0);
+  bcachesize(1);
+  bcachesize(nbuf);
+
+  sysinfo(&before);
+  t = uptime();
+  c = rdtsc();
+  for(i = 0; i < NFILE; i++){
+    filename(from, 's', i);
+    filename(to, 'd', i);
+    copy(from, to);
+  }
+  sync();
+  kc = (rdtsc() - c) >> 10;
+  t = uptime() - t;
+  sysinfo(&after);
+
+  printf(1, "%s: copied %d KB in %d ticks", after.idedma ? "DMA" : "PIO",
+         NFILE*FILESZ/1024, t);
+  if(t > 0)
+    printf(1, " (%d KB/s)", NFILE*FILESZ/1024 * 100 / t);
+  printf(1, "\ndriver: %d of %d Kcycles", after.idecycles - before.idecycles, kc);
+  if(kc > 0)
+    printf(1, " (%d%% of a CPU)", (after.idecycles - before.idecycles) * 100 / kc);
+  printf(1, "\n");
+
+  for(i = 0; i < NFILE; i++){
+    filename(from, 's', i);
+    unlink(from);
+    filename(to, 'd', i);
+    unlink(to);
+  }
+  exit();
+}
@@ -0,0 +1,176 @@
+// Disk throughput through the file system, with the caches
+// emptied before each read.  Sequential: NBIG files of BIGSZ
+// bytes written and read in order.  Random: NSMALL one-page
+// files, laid out on disk in creation order, read and
+// rewritten in a shuffled order.  Also times unlinking the big
+// files.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NBIG    16
+#define BIGSZ   (64*1024)
+#define NSMALL  128
+#define SMALLSZ 4096
+#define CHUNK   4096
+
+char buf[CHUNK];
+int order[NSMALL];
+
+void
+filename(char *name, char c, int i)
+{
+  name[0] = 'd';
+  name[1] = c;
+  name[2] = '0' + i/100;
+  name[3] = '0' + i/10%10;
+  name[4] = '0' + i%10;
+  name[5] = 0;
+}
+
+// Push everything out of the buffer cache: write it back, then
+// shrink the cache to nothing and grow it again.
+void
+dropcache(void)
+{
+  int nbuf;
+
+  sync();
+  nbuf = bcachesize(0);
+  bcachesize(1);
+  bcachesize(nbuf);
+}
+
+// Write size bytes to name, and on to the disk right away if
+// dosync is set.
+void
+writefile(char *name, int size, int dosync)
+{
+  int fd, i;
+
+  if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+    printf(1, "diskbench: create %s failed\n", name);
+    exit();
+  }
+  for(i = 0; i < size; i += CHUNK){
+    if(write(fd, buf, CHUNK) != CHUNK){
+      printf(1, "diskbench: write %s failed\n", name);
+      exit();
+    }
+  }
+  if(dosync)
+    fsync(fd);
+  close(fd);
+}
+
+void
+readfile(char *name)
+{
+  int fd;
+
+  if((fd = open(name, O_RDONLY)) < 0){
+    printf(1, "diskbench: open %s failed\n", name);
+    exit();
+  }
+  while(read(fd, buf, CHUNK) > 0)
+    ;
+  close(fd);
+}
+
+void
+report(char *what, int kb, int t)
+{
+  printf(1, "%s: %d KB in %d ticks", what, kb, t);
+  if(t > 0)
+    printf(1, " (%d KB/s)", kb * 100 / t);
+  printf(1, "\n");
+}
+
+void
+seqbench(void)
+{
+  char name[6];
+  int i, t, t1;
+
+  memset(buf, 's', CHUNK);
+  t = uptime();
+  for(i = 0; i < NBIG; i++){
+    filename(name, 's', i);
+    writefile(name, BIGSZ, 0);
+  }
+  sync();
+  report("sequential write", NBIG*BIGSZ/1024, uptime() - t);
+
+  dropcache();
+  t = uptime();
+  for(i = 0; i < NBIG; i++){
+    filename(name, 's', i);
+    readfile(name);
+  }
+  report("sequential read", NBIG*BIGSZ/1024, uptime() - t);
+
+  // The blocks are freed after unlink returns; sync waits for
+  // that.
+  t = uptime();
+  for(i = 0; i < NBIG; i++){
+    filename(name, 's', i);
+    unlink(name);
+  }
+  t1 = uptime();
+  sync();
+  printf(1, "unlink: %d files of %d KB in %d ticks, freed in %d\n",
+         NBIG, BIGSZ/1024, t1 - t, uptime() - t);
+}
+
+void
+randbench(void)
+{
+  char name[6];
+  uint seed;
+  int i, j, k, t;
+
+  memset(buf, 'r', CHUNK);
+  for(i = 0; i < NSMALL; i++){
+    filename(name, 'r', i);
+    writefile(name, SMALLSZ, 0);
+    order[i] = i;
+  }
+  seed = 1;
+  for(i = NSMALL-1; i > 0; i--){
+    seed = seed * 1103515245 + 12345;
+    j = (seed >> 16) % (i+1);
+    k = order[i];
+    order[i] = order[j];
+    order[j] = k;
+  }
+
+  dropcache();
+  t = uptime();
+  for(i = 0; i < NSMALL; i++){
+    filename(name, 'r', order[i]);
+    readfile(name);
+  }
+  report("random read", NSMALL*SMALLSZ/1024, uptime() - t);
+
+  t = uptime();
+  for(i = 0; i < NSMALL; i++){
+    filename(name, 'r', order[i]);
+    writefile(name, SMALLSZ, 1);
+  }
+  report("random write", NSMALL*SMALLSZ/1024, uptime() - t);
+
+  for(i = 0; i < NSMALL; i++){
+    filename(name, 'r', i);
+    unlink(name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  seqbench();
+  randbench();
+  exit();
+}
@@ -0,0 +1,138 @@
+// Large-file writes on a nearly full disk.  Fills the root file
+// system with FILLSZ-byte files until only a tenth of it is
+// free, deletes every FILLGAP'th one so that the free space is
+// scattered in holes over the disk, then writes NBIG files of
+// BIGSZ bytes and reads them back with the caches emptied.  The
+// fewer disk commands the read takes, the fewer pieces the
+// files were written in.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "sysinfo.h"
+
+#define FILLSZ  (32*1024)
+#define FILLGAP 4
+#define NFILL   180
+#define NBIG    4
+#define BIGSZ   (64*1024)
+#define CHUNK   4096
+
+char buf[CHUNK];
+
+void
+filename(char *name, char c, int i)
+{
+  name[0] = 'f';
+  name[1] = c;
+  name[2] = '0' + i/100;
+  name[3] = '0' + i/10%10;
+  name[4] = '0' + i%10;
+  name[5] = 0;
+}
+
+// Push everything out of the buffer cache.
+void
+dropcache(void)
+{
+  int nbuf;
+
+  sync();
+  nbuf = bcachesize(0);
+  bcachesize(1);
+  bcachesize(nbuf);
+}
+
+int
+writefile(char *name, int size)
+{
+  int fd, i;
+
+  if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+    return -1;
+  for(i = 0; i < size; i += CHUNK){
+    if(write(fd, buf, CHUNK) != CHUNK){
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+uint
+fsfree(void)
+{
+  struct sysinfo si;
+
+  sysinfo(&si);
+  return si.fsfree;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo si, before, after;
+  char name[6];
+  int i, nfill, fd, t;
+
+  sysinfo(&si);
+  memset(buf, 'f', CHUNK);
+  for(nfill = 0; nfill < NFILL && fsfree() > si.fsblocks / 10; nfill++){
+    filename(name, 'a', nfill);
+    if(writefile(name, FILLSZ) < 0){
+      unlink(name);
+      break;
+    }
+  }
+  for(i = 0; i < nfill; i += FILLGAP){
+    filename(name, 'a', i);
+    unlink(name);
+  }
+  sync();
+  sysinfo(&si);
+  printf(1, "%d of %d blocks free, in holes of %d KB\n",
+         si.fsfree, si.fsblocks, FILLSZ/1024);
+
+  memset(buf, 'b', CHUNK);
+  t = uptime();
+  for(i = 0; i < NBIG; i++){
+    filename(name, 'b', i);
+    if(writefile(name, BIGSZ) < 0){
+      printf(1, "fullbench: write %s failed\n", name);
+      break;
+    }
+  }
+  sync();
+  t = uptime() - t;
+  printf(1, "write: %d KB in %d ticks\n", NBIG*BIGSZ/1024, t);
+
+  dropcache();
+  sysinfo(&before);
+  t = uptime();
+  for(i = 0; i < NBIG; i++){
+    filename(name, 'b', i);
+    if((fd = open(name, O_RDONLY)) < 0)
+      continue;
+    while(read(fd, buf, CHUNK) > 0)
+      ;
+    close(fd);
+  }
+  t = uptime() - t;
+  sysinfo(&after);
+  printf(1, "read: %d KB in %d ticks, %d disk commands\n",
+         NBIG*BIGSZ/1024, t, after.idecmds - before.idecmds);
+
+  for(i = 0; i < NBIG; i++){
+    filename(name, 'b', i);
+    unlink(name);
+  }
+  for(i = 0; i < nfill; i++){
+    if(i % FILLGAP != 0){
+      filename(name, 'a', i);
+      unlink(name);
+    }
+  }
+  exit();
+}
@@ -0,0 +1,98 @@
+// Lock handoff latency between two threads: they take turns
+// NFUTEX times through a futex-based mutex and condition
+// variable, then NPOLL times by polling a shared word with
+// sleep(1) in between, the way code had to wait before futexes.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NFUTEX 20000
+#define NPOLL  50
+
+struct mutex m;
+struct cond c;
+volatile int turn;
+
+void
+futexpong(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NFUTEX; i++){
+    mutex_lock(&m);
+    while(turn != 1)
+      cond_wait(&c, &m);
+    turn = 0;
+    cond_signal(&c);
+    mutex_unlock(&m);
+  }
+  exit();
+}
+
+void
+futexbench(void)
+{
+  int i, t;
+
+  mutex_init(&m);
+  cond_init(&c);
+  turn = 0;
+  t = uptime();
+  if(thread_create(futexpong, 0) < 0){
+    printf(1, "lockbench: thread_create failed\n");
+    exit();
+  }
+  for(i = 0; i < NFUTEX; i++){
+    mutex_lock(&m);
+    while(turn != 0)
+      cond_wait(&c, &m);
+    turn = 1;
+    cond_signal(&c);
+    mutex_unlock(&m);
+  }
+  thread_join();
+  printf(1, "futex: %d handoffs in %d ticks\n", 2*NFUTEX, uptime() - t);
+}
+
+void
+pollpong(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NPOLL; i++){
+    while(turn != 1)
+      sleep(1);
+    turn = 0;
+  }
+  exit();
+}
+
+void
+pollbench(void)
+{
+  int i, t;
+
+  turn = 0;
+  t = uptime();
+  if(thread_create(pollpong, 0) < 0){
+    printf(1, "lockbench: thread_create failed\n");
+    exit();
+  }
+  for(i = 0; i < NPOLL; i++){
+    while(turn != 0)
+      sleep(1);
+    turn = 1;
+  }
+  thread_join();
+  printf(1, "sleep(1) polling: %d handoffs in %d ticks\n",
+         2*NPOLL, uptime() - t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  futexbench();
+  pollbench();
+  exit();
+}
@@ -2,18 +2,30 @@
 # user programs
 USER_PROGS := \
 	cat\
+	copybench\
+	diskbench\
 	echo\
 	forktest\
+	fullbench\
 	grep\
 	init\
 	kill\
 	ln\
+	lockbench\
+	membench\
+	mmapbench\
 	printpinfo\
+	preadbench\
 	ls\
 	mkdir\
+	mount\
 	rm\
+	seekbench\
 	sh\
+	shmbench\
+	ssebench\
 	stressfs\
+	sysinfo\
 	tester\
 	usertests\
 	wc\
@@ -26,7 +38,8 @@ USER_LIBS := \
 	ulib.o\
 	usys.o\
 	printf.o\
-	umalloc.o
+	umalloc.o\
+	uthread.o
 
 USER_LIBS := $(addprefix user/, $(USER_LIBS))
 
@@ -58,6 +71,9 @@ USER_CFLAGS += -fno-stack-protector
 # generate code for 32-bit environment
 USER_CFLAGS += -m32
 
+# user programs may use SSE; the kernel saves it (see kernel/fpu.c)
+USER_CFLAGS += -msse
+
 # generate code for 32-bit environment
 USER_ASFLAGS := $(USER_CFLAGS)
 
@@ -0,0 +1,95 @@
+// Memory allocation microbenchmarks: fork, fork+exec and
+// sbrk, timed in clock ticks.  The sysinfo line shows how
+// much free memory idle CPUs have pre-zeroed for kalloc_zeroed.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "sysinfo.h"
+
+#define PAGE   4096
+#define NFORK  200
+#define NEXEC  100
+#define NSBRK  100
+#define SBRKSZ (256*PAGE)   // 1MB per sbrk round
+
+void
+forkbench(void)
+{
+  int i, pid, t;
+
+  t = uptime();
+  for(i = 0; i < NFORK; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "membench: fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait();
+  }
+  printf(1, "fork+exit+wait: %d x in %d ticks\n", NFORK, uptime() - t);
+}
+
+void
+execbench(void)
+{
+  char *argv[] = { "membench", "-", 0 };
+  int i, pid, t;
+
+  t = uptime();
+  for(i = 0; i < NEXEC; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "membench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec("membench", argv);
+      printf(1, "membench: exec failed\n");
+      exit();
+    }
+    wait();
+  }
+  printf(1, "fork+exec+wait: %d x in %d ticks\n", NEXEC, uptime() - t);
+}
+
+void
+sbrkbench(void)
+{
+  char *a, *p;
+  int i, t;
+
+  t = uptime();
+  for(i = 0; i < NSBRK; i++){
+    a = sbrk(SBRKSZ);
+    if(a == (char*)-1){
+      printf(1, "membench: sbrk failed\n");
+      exit();
+    }
+    for(p = a; p < a + SBRKSZ; p += PAGE)
+      *p = 1;
+    sbrk(-SBRKSZ);
+  }
+  printf(1, "sbrk+touch+free 1MB: %d x in %d ticks\n", NSBRK, uptime() - t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo si;
+
+  // Child of execbench: nothing to do.
+  if(argc > 1)
+    exit();
+
+  sleep(10);  // let idle CPUs refill the zeroed pool
+  sysinfo(&si);
+  printf(1, "free %d KB, %d KB pre-zeroed\n",
+         si.freeram / 1024, si.zeroram / 1024);
+  forkbench();
+  execbench();
+  sbrkbench();
+  exit();
+}
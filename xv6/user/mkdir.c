@@ -5,15 +5,16 @@
 int
 main(int argc, char *argv[])
 {
-  int i;
+  int i, hashed;
 
-  if(argc < 2){
-    printf(2, "Usage: mkdir files...\n");
+  hashed = argc > 1 && strcmp(argv[1], "-h") == 0;
+  if(argc < 2 + hashed){
+    printf(2, "Usage: mkdir [-h] files...\n");
     exit();
   }
 
-  for(i = 1; i < argc; i++){
-    if(mkdir(argv[i]) < 0){
+  for(i = 1 + hashed; i < argc; i++){
+    if((hashed ? mkhashdir(argv[i]) : mkdir(argv[i])) < 0){
       printf(2, "mkdir: %s failed to create\n", argv[i]);
       break;
     }
@@ -0,0 +1,88 @@
+// Scanning a file with read() versus through mmap.  Both runs
+// add up every byte of a FILESZ-byte file NSCAN times; the read
+// run copies CHUNK bytes per call, the mmap run maps the file
+// once and reads the page cache in place.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define CHUNK  512
+#define FILESZ (64*1024)
+#define NSCAN  200
+
+char buf[CHUNK];
+
+void
+mkfile(void)
+{
+  int fd, i;
+
+  unlink("mmapbench.tmp");
+  if((fd = open("mmapbench.tmp", O_CREATE|O_RDWR)) < 0){
+    printf(1, "mmapbench: create failed\n");
+    exit();
+  }
+  for(i = 0; i < CHUNK; i++)
+    buf[i] = i;
+  for(i = 0; i < FILESZ; i += CHUNK){
+    if(write(fd, buf, CHUNK) != CHUNK){
+      printf(1, "mmapbench: write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+}
+
+void
+readbench(void)
+{
+  int fd, i, j, n, t;
+  uint s;
+
+  t = uptime();
+  s = 0;
+  for(i = 0; i < NSCAN; i++){
+    fd = open("mmapbench.tmp", O_RDONLY);
+    while((n = read(fd, buf, CHUNK)) > 0)
+      for(j = 0; j < n; j++)
+        s += (uchar)buf[j];
+    close(fd);
+  }
+  printf(1, "read: %d KB in %d ticks (sum %d)\n",
+         NSCAN*FILESZ/1024, uptime() - t, s);
+}
+
+void
+mmapbench(void)
+{
+  int fd, i, j, t;
+  uchar *a;
+  uint s;
+
+  t = uptime();
+  fd = open("mmapbench.tmp", O_RDONLY);
+  if((a = mmap(fd, 0, FILESZ, PROT_READ)) == (void*)-1){
+    printf(1, "mmapbench: mmap failed\n");
+    exit();
+  }
+  close(fd);
+  s = 0;
+  for(i = 0; i < NSCAN; i++)
+    for(j = 0; j < FILESZ; j++)
+      s += a[j];
+  munmap(a, FILESZ);
+  printf(1, "mmap: %d KB in %d ticks (sum %d)\n",
+         NSCAN*FILESZ/1024, uptime() - t, s);
+}
+
+int
+main(int argc, char *argv[])
+{
+  mkfile();
+  readbench();
+  mmapbench();
+  unlink("mmapbench.tmp");
+  exit();
+}
@@ -0,0 +1,15 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(argc != 3){
+    printf(2, "Usage: mount dir disk\n");
+    exit();
+  }
+  if(mount(argv[1], atoi(argv[2])) < 0)
+    printf(2, "mount %s %s: failed\n", argv[1], argv[2]);
+  exit();
+}
@@ -0,0 +1,127 @@
+// Parallel reads of distinct files.  Each of up to NWORKER
+// processes reads its own NFILE files NPASS times; the run is
+// repeated with 1, 2 and NWORKER processes.  Every worker's
+// files together are larger than the page cache, so the reads
+// miss there and come from the buffer cache, and the workers
+// only share a buffer cache lock if their blocks hash to the
+// same bucket.  Run with CPUS=4 to see it scale.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "sysinfo.h"
+
+#define NWORKER 4
+#define NFILE   18
+#define FILESZ  (64*1024)
+#define NPASS   4
+#define CHUNK   4096
+
+char buf[CHUNK];
+
+void
+filename(char *name, int w, int f)
+{
+  strcpy(name, "pread");
+  name[5] = '0' + w;
+  name[6] = 'a' + f;
+  name[7] = 0;
+}
+
+void
+mkfiles(void)
+{
+  char name[8];
+  int w, f, i, fd;
+
+  memset(buf, 'x', CHUNK);
+  for(w = 0; w < NWORKER; w++){
+    for(f = 0; f < NFILE; f++){
+      filename(name, w, f);
+      if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+        printf(1, "preadbench: create %s failed\n", name);
+        exit();
+      }
+      for(i = 0; i < FILESZ; i += CHUNK){
+        if(write(fd, buf, CHUNK) != CHUNK){
+          printf(1, "preadbench: write %s failed\n", name);
+          exit();
+        }
+      }
+      close(fd);
+    }
+  }
+  sync();
+}
+
+void
+rmfiles(void)
+{
+  char name[8];
+  int w, f;
+
+  for(w = 0; w < NWORKER; w++){
+    for(f = 0; f < NFILE; f++){
+      filename(name, w, f);
+      unlink(name);
+    }
+  }
+}
+
+void
+worker(int w)
+{
+  char name[8];
+  int i, f, fd;
+
+  for(i = 0; i < NPASS; i++){
+    for(f = 0; f < NFILE; f++){
+      filename(name, w, f);
+      fd = open(name, O_RDONLY);
+      while(read(fd, buf, CHUNK) > 0)
+        ;
+      close(fd);
+    }
+  }
+  exit();
+}
+
+void
+run(int n)
+{
+  struct sysinfo before, after;
+  int w, t;
+
+  sysinfo(&before);
+  t = uptime();
+  for(w = 0; w < n; w++){
+    if(fork() == 0)
+      worker(w);
+  }
+  for(w = 0; w < n; w++)
+    wait();
+  t = uptime() - t;
+  sysinfo(&after);
+  printf(1, "%d procs: %d KB in %d ticks, %d buffer cache hits\n",
+         n, n*NPASS*NFILE*FILESZ/1024, t, after.nbhit - before.nbhit);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nbuf;
+
+  // Keep every block cached; writing the files puts them there.
+  nbuf = bcachesize(0);
+  if(nbuf < 2*NWORKER*NFILE*FILESZ/512 &&
+     bcachesize(2*NWORKER*NFILE*FILESZ/512) < NWORKER*NFILE*FILESZ/512)
+    printf(1, "preadbench: buffer cache too small\n");
+  mkfiles();
+  run(1);
+  run(2);
+  run(NWORKER);
+  rmfiles();
+  bcachesize(nbuf);
+  exit();
+}
@@ -0,0 +1,151 @@
+// Scattered concurrent reads under each disk scheduler.  Each
+// of NWORKER processes owns NFILE files, created round-robin
+// so that every worker's files are spread across the disk, and
+// reads them in its own shuffled order with the caches emptied.
+// Prints the time, the average queue depth and the average seek
+// of the run with FIFO and with C-LOOK.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "sysinfo.h"
+
+#define NWORKER 4
+#define NFILE   16
+#define FILESZ  (32*1024)
+#define CHUNK   4096
+
+char buf[CHUNK];
+
+void
+filename(char *name, int w, int f)
+{
+  name[0] = 'k';
+  name[1] = '0' + w;
+  name[2] = 'a' + f;
+  name[3] = 0;
+}
+
+void
+dropcache(void)
+{
+  int nbuf;
+
+  sync();
+  nbuf = bcachesize(0);
+  bcachesize(1);
+  bcachesize(nbuf);
+}
+
+void
+mkfiles(void)
+{
+  char name[4];
+  int w, f, i, fd;
+
+  memset(buf, 'k', CHUNK);
+  for(f = 0; f < NFILE; f++){
+    for(w = 0; w < NWORKER; w++){
+      filename(name, w, f);
+      if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+        printf(1, "seekbench: create %s failed\n", name);
+        exit();
+      }
+      for(i = 0; i < FILESZ; i += CHUNK)
+        write(fd, buf, CHUNK);
+      close(fd);
+    }
+  }
+}
+
+void
+rmfiles(void)
+{
+  char name[4];
+  int w, f;
+
+  for(w = 0; w < NWORKER; w++){
+    for(f = 0; f < NFILE; f++){
+      filename(name, w, f);
+      unlink(name);
+    }
+  }
+}
+
+void
+worker(int w)
+{
+  char name[4];
+  int order[NFILE];
+  uint seed;
+  int i, j, k, fd;
+
+  for(i = 0; i < NFILE; i++)
+    order[i] = i;
+  seed = w + 1;
+  for(i = NFILE-1; i > 0; i--){
+    seed = seed * 1103515245 + 12345;
+    j = (seed >> 16) % (i+1);
+    k = order[i];
+    order[i] = order[j];
+    order[j] = k;
+  }
+  for(i = 0; i < NFILE; i++){
+    filename(name, w, order[i]);
+    fd = open(name, O_RDONLY);
+    while(read(fd, buf, CHUNK) > 0)
+      ;
+    close(fd);
+  }
+  exit();
+}
+
+void
+run(char *sched)
+{
+  struct sysinfo before, after;
+  uint reqs, cmds;
+  int w, t;
+
+  if(iosched(sched) < 0){
+    printf(1, "seekbench: no scheduler %s\n", sched);
+    return;
+  }
+  dropcache();
+  sysinfo(&before);
+  t = uptime();
+  for(w = 0; w < NWORKER; w++){
+    if(fork() == 0)
+      worker(w);
+  }
+  for(w = 0; w < NWORKER; w++)
+    wait();
+  t = uptime() - t;
+  sysinfo(&after);
+  reqs = after.idereqs - before.idereqs;
+  cmds = after.idecmds - before.idecmds;
+  printf(1, "%s: %d KB in %d ticks, %d requests in %d commands",
+         sched, NWORKER*NFILE*FILESZ/1024, t, reqs, cmds);
+  if(reqs > 0)
+    printf(1, ", average depth %d",
+           (after.idedepth - before.idedepth) / reqs);
+  if(cmds > 0)
+    printf(1, ", average seek %d sectors",
+           (after.ideseek - before.ideseek) / cmds);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo si;
+
+  sysinfo(&si);
+  mkfiles();
+  run("fifo");
+  run("clook");
+  iosched(si.iosched);
+  rmfiles();
+  exit();
+}
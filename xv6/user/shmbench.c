@@ -0,0 +1,132 @@
+// Producer/consumer throughput over a shared memory segment
+// versus a pipe.  The producer fills CHUNK-byte chunks, the
+// consumer adds up their bytes; both runs move TOTAL bytes.
+// The shared memory run uses a ring of NSLOT chunks with the
+// counters in the first page of the segment, and spins (it
+// is meant for more than one CPU).
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define CHUNK  4096
+#define NSLOT  16
+#define TOTAL  (16*1024*1024)
+#define NCHUNK (TOTAL/CHUNK)
+
+// Keep the compiler from moving chunk accesses across the
+// counter updates.
+#define barrier() asm volatile("" : : : "memory")
+
+struct ring {
+  volatile uint head;   // chunks produced
+  volatile uint tail;   // chunks consumed
+  char pad[CHUNK - 2*sizeof(uint)];
+  char slot[NSLOT][CHUNK];
+};
+
+char buf[CHUNK];
+
+void
+fill(char *p, uint i)
+{
+  memset(p, i & 0xff, CHUNK);
+}
+
+uint
+sum(char *p)
+{
+  uint i, s;
+
+  s = 0;
+  for(i = 0; i < CHUNK; i++)
+    s += (uchar)p[i];
+  return s;
+}
+
+void
+pipebench(void)
+{
+  int fds[2], i, n, t;
+  uint s;
+
+  if(pipe(fds) < 0){
+    printf(1, "shmbench: pipe failed\n");
+    exit();
+  }
+  t = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(i = 0; i < NCHUNK; i++){
+      fill(buf, i);
+      if(write(fds[1], buf, CHUNK) != CHUNK){
+        printf(1, "shmbench: write failed\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  close(fds[1]);
+  s = 0;
+  for(i = 0; i < NCHUNK; i++){
+    for(n = 0; n < CHUNK; ){
+      int r = read(fds[0], buf + n, CHUNK - n);
+      if(r <= 0){
+        printf(1, "shmbench: read failed\n");
+        exit();
+      }
+      n += r;
+    }
+    s += sum(buf);
+  }
+  close(fds[0]);
+  wait();
+  printf(1, "pipe: %d KB in %d ticks (sum %d)\n", TOTAL/1024, uptime() - t, s);
+}
+
+void
+shmbench(void)
+{
+  struct ring *r;
+  int id, i, t;
+  uint s;
+
+  if((id = shmcreate("shmbench", sizeof(struct ring))) < 0 ||
+     (r = shmattach(id)) == (void*)-1){
+    printf(1, "shmbench: shm failed\n");
+    exit();
+  }
+  r->head = r->tail = 0;
+  t = uptime();
+  if(fork() == 0){
+    for(i = 0; i < NCHUNK; i++){
+      while(r->head - r->tail == NSLOT)
+        ;
+      barrier();
+      fill(r->slot[i % NSLOT], i);
+      barrier();
+      r->head++;
+    }
+    exit();
+  }
+  s = 0;
+  for(i = 0; i < NCHUNK; i++){
+    while(r->head == r->tail)
+      ;
+    barrier();
+    s += sum(r->slot[i % NSLOT]);
+    barrier();
+    r->tail++;
+  }
+  wait();
+  printf(1, "shm:  %d KB in %d ticks (sum %d)\n", TOTAL/1024, uptime() - t, s);
+  shmdetach(r);
+}
+
+int
+main(int argc, char *argv[])
+{
+  pipebench();
+  shmbench();
+  exit();
+}
@@ -0,0 +1,76 @@
+// Dot product of two N-float vectors, NROUND times: a scalar
+// C loop against an SSE loop that multiplies and adds four
+// floats per instruction.  The kernel switches FPU/SSE state
+// lazily (kernel/fpu.c), so both run with their own registers.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define N      4096
+#define NROUND 2000
+
+float a[N] __attribute__((aligned(16)));
+float b[N] __attribute__((aligned(16)));
+
+float
+dotscalar(void)
+{
+  float s;
+  int i;
+
+  s = 0;
+  for(i = 0; i < N; i++)
+    s += a[i] * b[i];
+  return s;
+}
+
+float
+dotsse(void)
+{
+  float part[4] __attribute__((aligned(16)));
+  int i;
+
+  i = 0;
+  asm volatile("xorps %%xmm0, %%xmm0\n\t"
+               "1:\n\t"
+               "movaps (%2,%1,4), %%xmm1\n\t"
+               "mulps (%3,%1,4), %%xmm1\n\t"
+               "addps %%xmm1, %%xmm0\n\t"
+               "addl $4, %1\n\t"
+               "cmpl %4, %1\n\t"
+               "jb 1b\n\t"
+               "movaps %%xmm0, %0"
+               : "=m" (part), "+r" (i)
+               : "r" (a), "r" (b), "i" (N)
+               : "xmm0", "xmm1", "cc");
+  return part[0] + part[1] + part[2] + part[3];
+}
+
+void
+bench(char *name, float (*dot)(void))
+{
+  int i, t;
+  float s;
+
+  s = 0;
+  t = uptime();
+  for(i = 0; i < NROUND; i++)
+    s = dot();
+  printf(1, "%s: %d dot products of %d floats in %d ticks (result %d)\n",
+         name, NROUND, N, uptime() - t, (int)s);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  for(i = 0; i < N; i++){
+    a[i] = 1;
+    b[i] = i % 8;
+  }
+  bench("scalar", dotscalar);
+  bench("sse", dotsse);
+  exit();
+}
@@ -0,0 +1,40 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "sysinfo.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo si;
+
+  if(sysinfo(&si) < 0){
+    printf(2, "sysinfo failed\n");
+    exit();
+  }
+  printf(1, "memory: %d KB total, %d KB free\n",
+         si.totalram / 1024, si.freeram / 1024);
+  printf(1, "swap: %d KB total, %d KB free, %d pages in, %d pages out\n",
+         si.totalswap / 1024, si.freeswap / 1024, si.nswapin, si.nswapout);
+  printf(1, "bcache: %d buffers, %d hits, %d misses, %d dirty, "
+         "%d read ahead\n",
+         si.nbuf, si.nbhit, si.nbmiss, si.nbdirty, si.nbahead);
+  printf(1, "disk: %s, %d Kcycles in the driver, %d errors\n",
+         si.idedma ? "DMA" : "PIO", si.idecycles, si.ideerrors);
+  printf(1, "disk queue: %s, %d requests, %d commands",
+         si.iosched, si.idereqs, si.idecmds);
+  if(si.idereqs > 0)
+    printf(1, ", average depth %d", si.idedepth / si.idereqs);
+  if(si.idecmds > 0)
+    printf(1, ", average seek %d sectors", si.ideseek / si.idecmds);
+  printf(1, "\n");
+  printf(1, "root fs: %d blocks, %d free\n", si.fsblocks, si.fsfree);
+  printf(1, "icache: %d inodes, %d read from disk\n", si.ninode, si.niread);
+  printf(1, "dcache: %d hits, %d negative hits, %d misses",
+         si.ndchit, si.ndcneg, si.ndcmiss);
+  if(si.ndchit + si.ndcneg + si.ndcmiss > 0)
+    printf(1, " (%d%% hit)", 100 * (si.ndchit + si.ndcneg) /
+           (si.ndchit + si.ndcneg + si.ndcmiss));
+  printf(1, "\n");
+  exit();
+}
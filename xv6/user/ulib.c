@@ -103,3 +103,69 @@ memmove(void *vdst, void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Mutexes and condition variables on futexes.  A mutex is 0
+// when free, 1 when held, and 2 when held and somebody may be
+// waiting; only the last state costs a system call to unlock.
+
+static inline uint
+fetchadd(volatile uint *addr, uint n)
+{
+  asm volatile("lock; xaddl %0, %1" : "+r" (n), "+m" (*addr) : : "cc");
+  return n;
+}
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  if(xchg(&m->state, 1) == 0)
+    return;
+  while(xchg(&m->state, 2) != 0)
+    futex_wait(&m->state, 2);
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(xchg(&m->state, 0) == 2)
+    futex_wake(&m->state, 1);
+}
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+// Release m, sleep until signalled, and take m again.  May
+// return without a signal, so callers wait in a loop.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  uint seq;
+
+  seq = c->seq;
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  fetchadd(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  fetchadd(&c->seq, 1);
+  futex_wake(&c->seq, 0x7fffffff);  // everybody
+}
@@ -3,6 +3,16 @@
 
 struct stat;
 struct pstat;
+struct sysinfo;
+
+// futex-based locks (ulib.c)
+struct mutex {
+  volatile uint state;
+};
+
+struct cond {
+  volatile uint seq;
+};
 
 // system calls
 int fork(void);
@@ -27,6 +37,22 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int getpinfo(struct pstat *);
+int sysinfo(struct sysinfo*);
+int shmcreate(char*, int);
+void* shmattach(int);
+int shmdetach(void*);
+void* mmap(int, int, int, int);
+int munmap(void*, int);
+int clone(void(*)(void*), void*, void*);
+int join(void**);
+int futex_wait(volatile uint*, uint);
+int futex_wake(volatile uint*, int);
+int bcachesize(int);
+int sync(void);
+int fsync(int);
+int iosched(char*);
+int mount(char*, int);
+int mkhashdir(char*);
 
 // user library functions (ulib.c)
 int stat(char*, struct stat*);
@@ -41,6 +67,17 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+
+// user-level threads (uthread.c)
+int thread_create(void(*)(void*), void*);
+int thread_join(void);
 
 #endif // _USER_H_
 
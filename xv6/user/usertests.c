@@ -1,13 +1,15 @@
 #include "types.h"
+#include "param.h"
 #include "stat.h"
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
 #include "syscall.h"
 #include "traps.h"
+#include "sysinfo.h"
 
 #define PAGE (4096)
-#define MAX_PROC_MEM (640 * 1024)
+#define BIG (64 * 1024 * 1024)  // well past the old 640K limit
 
 char buf[2048];
 char name[3];
@@ -1274,21 +1276,28 @@ sbrktest(void)
     exit();
   wait();
 
-  // can one allocate the full 640K?
+  // can one grow well beyond 640K?
   a = sbrk(0);
-  amt = (640 * 1024) - (uint)a;
+  amt = BIG - (uint)a;
   p = sbrk(amt);
   if(p != a){
-    printf(stdout, "sbrk test failed 640K test, p %x a %x\n", p, a);
+    printf(stdout, "sbrk test failed to grow big, p %x a %x\n", p, a);
     exit();
   }
-  lastaddr = (char*)(640 * 1024 - 1);
+  lastaddr = (char*)(BIG - 1);
   *lastaddr = 99;
 
-  // is one forbidden from allocating more than 640K?
-  c = sbrk(4096);
+  // is one forbidden from growing into the kernel at USERTOP?
+  c = sbrk(USERTOP - (uint)sbrk(0) + 4096);
+  if(c != (char*)0xffffffff){
+    printf(stdout, "sbrk allocated past USERTOP, c %x\n", c);
+    exit();
+  }
+
+  // does shrinking below zero, which wraps around, fail?
+  c = sbrk(-((uint)sbrk(0) + 4096));
   if(c != (char*)0xffffffff){
-    printf(stdout, "sbrk allocated more than 640K, c %x\n", c);
+    printf(stdout, "sbrk wrapped around, c %x\n", c);
     exit();
   }
 
@@ -1318,14 +1327,11 @@ sbrktest(void)
     exit();
   }
 
-  c = sbrk(4096);
-  if(c != (char*)0xffffffff){
-    printf(stdout, "sbrk was able to re-allocate beyond 640K, c %x\n", c);
-    exit();
-  }
+  // shrink back so the forks below don't copy BIG bytes each
+  sbrk(-(sbrk(0) - oldbrk));
 
   // can we read the kernel's memory?
-  for(a = (char*)(640*1024); a < (char*)2000000; a += 50000){
+  for(a = (char*)USERTOP; a < (char*)(USERTOP+2000000); a += 50000){
     ppid = getpid();
     pid = fork();
     if(pid < 0){
@@ -1342,15 +1348,14 @@ sbrktest(void)
 
   // if we run the system out of memory, does it clean up the last
   // failed allocation?
-  sbrk(-(sbrk(0) - oldbrk));
   if(pipe(fds) != 0){
     printf(1, "pipe() failed\n");
     exit();
   }
   for(i = 0; i < sizeof(pids)/sizeof(pids[0]); i++){
     if((pids[i] = fork()) == 0){
-      // allocate the full 640K - 1 page
-      sbrk(MAX_PROC_MEM - (1 * PAGE) - (uint)sbrk(0));
+      // allocate BIG - 1 page; together they exhaust memory
+      sbrk(BIG - (1 * PAGE) - (uint)sbrk(0));
       write(fds[1], "x", 1);
       // sit around until killed
       for(;;) sleep(1000);
@@ -1361,8 +1366,8 @@ sbrktest(void)
   kill(pids[0]);
   wait();
   if((pids[0] = fork()) == 0){
-     // allocate the full 640K page
-     sbrk(MAX_PROC_MEM - (uint)sbrk(0));
+     // allocate all of BIG
+     sbrk(BIG - (uint)sbrk(0));
      write(fds[1], "x", 1);
      // sit around until killed
      for(;;) sleep(1000);
@@ -1454,6 +1459,836 @@ bsstest(void)
   printf(stdout, "bss test ok\n");
 }
 
+// does sysinfo see the memory a process allocates and frees?
+void
+sysinfotest(void)
+{
+  struct sysinfo before, after;
+
+  printf(stdout, "sysinfo test\n");
+  if(sysinfo(&before) < 0 || before.freeram > before.totalram){
+    printf(stdout, "sysinfo failed\n");
+    exit();
+  }
+  if(sbrk(10*PAGE) == (char*)0xffffffff){
+    printf(stdout, "sysinfo test sbrk failed\n");
+    exit();
+  }
+  sysinfo(&after);
+  if(after.freeram > before.freeram - 10*PAGE){
+    printf(stdout, "sysinfo missed an allocation, %d then %d free\n",
+           before.freeram, after.freeram);
+    exit();
+  }
+  sbrk(-10*PAGE);
+  sysinfo(&after);
+  if(after.freeram + PAGE < before.freeram){
+    printf(stdout, "sysinfo missed a free, %d then %d free\n",
+           before.freeram, after.freeram);
+    exit();
+  }
+  printf(stdout, "sysinfo test ok\n");
+}
+
+// shared memory: does a child see the parent's segment, and
+// does the parent see what the child wrote?
+void
+shmtest(void)
+{
+  int id, pid;
+  char *a, *b;
+
+  printf(stdout, "shm test\n");
+  id = shmcreate("shmtest", 2*PAGE);
+  if(id < 0 || shmcreate("shmtest", PAGE) != id){
+    printf(stdout, "shmcreate failed\n");
+    exit();
+  }
+  if(shmcreate("shmtest", 3*PAGE) >= 0){
+    printf(stdout, "shmcreate grew a segment\n");
+    exit();
+  }
+  a = shmattach(id);
+  if(a == (char*)0xffffffff || shmattach(id) != a){
+    printf(stdout, "shmattach failed\n");
+    exit();
+  }
+  a[0] = 'p';
+  pid = fork();
+  if(pid == 0){
+    // inherited from the parent
+    if(a[0] != 'p')
+      printf(stdout, "shm child saw %x\n", a[0]);
+    a[PAGE] = 'c';
+    shmdetach(a);
+    // attaching again by name gives the same memory
+    b = shmattach(shmcreate("shmtest", PAGE));
+    if(b != a || b[PAGE] != 'c')
+      printf(stdout, "shm reattach failed\n");
+    exit();
+  }
+  wait();
+  if(a[PAGE] != 'c'){
+    printf(stdout, "shm parent missed child's write\n");
+    exit();
+  }
+  if(shmdetach(a) < 0 || shmdetach(a) == 0){
+    printf(stdout, "shmdetach failed\n");
+    exit();
+  }
+  // the last detach freed it; a new one starts out zeroed
+  a = shmattach(shmcreate("shmtest", PAGE));
+  if(a == (char*)0xffffffff || a[PAGE] != 0){
+    printf(stdout, "shm segment outlived its last detach\n");
+    exit();
+  }
+  shmdetach(a);
+  printf(stdout, "shm test ok\n");
+}
+
+// a file mapping sees the file, read() sees stores through
+// the mapping, and the mapping sees write()s.
+void
+mmaptest(void)
+{
+  int fd, i, n;
+  char *a;
+
+  printf(stdout, "mmap test\n");
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  for(n = 0; n < 2*PAGE; n += sizeof(buf)){
+    for(i = 0; i < sizeof(buf); i++)
+      buf[i] = 'a' + (n + i) % 26;
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(stdout, "mmap test write failed\n");
+      exit();
+    }
+  }
+  if(mmap(fd, 1, PAGE, PROT_READ) != (void*)-1 ||
+     mmap(fd, 0, 3*PAGE, PROT_READ) != (void*)-1){
+    printf(stdout, "mmap accepted a bad range\n");
+    exit();
+  }
+  a = mmap(fd, 0, 2*PAGE, PROT_READ|PROT_WRITE);
+  if(a == (char*)-1){
+    printf(stdout, "mmap failed\n");
+    exit();
+  }
+  for(i = 0; i < 2*PAGE; i++){
+    if(a[i] != 'a' + i % 26){
+      printf(stdout, "mmap byte %d is %x\n", i, a[i]);
+      exit();
+    }
+  }
+  a[PAGE] = 'X';
+  close(fd);
+  fd = open("mmapfile", O_RDWR);
+  for(n = 0; n < PAGE; n += sizeof(buf))
+    read(fd, buf, sizeof(buf));
+  if(read(fd, buf, 1) != 1 || buf[0] != 'X'){
+    printf(stdout, "read missed a store through mmap\n");
+    exit();
+  }
+  if(write(fd, "Y", 1) != 1 || a[PAGE+1] != 'Y'){
+    printf(stdout, "mmap missed a write\n");
+    exit();
+  }
+  if(munmap(a, 2*PAGE) < 0 || munmap(a, 2*PAGE) == 0){
+    printf(stdout, "munmap failed\n");
+    exit();
+  }
+  close(fd);
+  unlink("mmapfile");
+  printf(stdout, "mmap test ok\n");
+}
+
+// threads share memory with their creator, sbrk included,
+// and die with it.
+volatile int tcount[4];
+char *tbrk;
+
+void
+threadfn(void *arg)
+{
+  int i = (int)arg;
+
+  tcount[i] = i + 1;
+  if(i == 0){
+    tbrk = sbrk(PAGE);
+    tbrk[0] = 't';
+  }
+  exit();
+}
+
+void
+threadspin(void *arg)
+{
+  for(;;)
+    ;
+}
+
+void
+threadtest(void)
+{
+  int i, pid;
+
+  printf(stdout, "thread test\n");
+  for(i = 0; i < 4; i++){
+    if(thread_create(threadfn, (void*)i) < 0){
+      printf(stdout, "thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++){
+    if(thread_join() < 0){
+      printf(stdout, "thread_join failed\n");
+      exit();
+    }
+  }
+  if(thread_join() != -1 || wait() != -1){
+    printf(stdout, "joined or waited for a thread twice\n");
+    exit();
+  }
+  for(i = 0; i < 4; i++){
+    if(tcount[i] != i + 1){
+      printf(stdout, "thread %d did not run\n", i);
+      exit();
+    }
+  }
+  if(tbrk == 0 || tbrk[0] != 't' || sbrk(0) != tbrk + PAGE){
+    printf(stdout, "thread sbrk not shared\n");
+    exit();
+  }
+  sbrk(-PAGE);
+
+  // failed clones must not leave their slots on the run queue,
+  // or the processes queued behind them would never run again
+  for(i = 0; i < 2*NPROC; i++){
+    if(clone(threadfn, 0, (void*)1) != -1){
+      printf(stdout, "clone with an unaligned stack succeeded\n");
+      exit();
+    }
+  }
+
+  // exiting kills the threads left behind
+  pid = fork();
+  if(pid == 0){
+    thread_create(threadspin, 0);
+    exit();
+  }
+  if(wait() != pid){
+    printf(stdout, "thread test wait failed\n");
+    exit();
+  }
+  printf(stdout, "thread test ok\n");
+}
+
+// futex-based mutexes and condition variables between threads
+struct mutex fmutex;
+struct cond fcond;
+volatile int fcount, fturn;
+
+void
+futexfn(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++){
+    mutex_lock(&fmutex);
+    fcount++;
+    mutex_unlock(&fmutex);
+  }
+  // take turns with the main thread
+  for(i = 0; i < 100; i++){
+    mutex_lock(&fmutex);
+    while(fturn != 1)
+      cond_wait(&fcond, &fmutex);
+    fturn = 0;
+    cond_broadcast(&fcond);
+    mutex_unlock(&fmutex);
+  }
+  exit();
+}
+
+void
+futextest(void)
+{
+  uint word;
+  int i;
+
+  printf(stdout, "futex test\n");
+  word = 1;
+  if(futex_wait(&word, 0) != -1 || futex_wake(&word, 1) != 0){
+    printf(stdout, "futex on a changed word\n");
+    exit();
+  }
+  mutex_init(&fmutex);
+  cond_init(&fcond);
+  fcount = 0;
+  fturn = 0;
+  for(i = 0; i < 4; i++){
+    if(thread_create(futexfn, 0) < 0){
+      printf(stdout, "futex test thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 4*100; i++){
+    mutex_lock(&fmutex);
+    while(fturn != 0)
+      cond_wait(&fcond, &fmutex);
+    fturn = 1;
+    cond_broadcast(&fcond);
+    mutex_unlock(&fmutex);
+  }
+  for(i = 0; i < 4; i++)
+    thread_join();
+  if(fcount != 4*1000 || fturn != 0){
+    printf(stdout, "futex test count %d turn %d\n", fcount, fturn);
+    exit();
+  }
+  printf(stdout, "futex test ok\n");
+}
+
+// Spin n times with v in %xmm0; return what %xmm0 holds after.
+uint
+xmmspin(uint v, int n)
+{
+  uint r;
+
+  asm volatile("movd %2, %%xmm0\n\t"
+               "1: decl %1\n\t"
+               "jnz 1b\n\t"
+               "movd %%xmm0, %0"
+               : "=r" (r), "+r" (n) : "r" (v) : "xmm0", "cc");
+  return r;
+}
+
+// processes keep their own SSE registers across switches
+void
+fputest(void)
+{
+  int pid;
+
+  printf(stdout, "fpu test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fpu test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(xmmspin(0xc0ffee, 20000000) != 0xc0ffee)
+      printf(stdout, "fpu test child lost its registers\n");
+    exit();
+  }
+  if(xmmspin(0xbeef, 20000000) != 0xbeef){
+    printf(stdout, "fpu test parent lost its registers\n");
+    exit();
+  }
+  wait();
+  printf(stdout, "fpu test ok\n");
+}
+
+// the buffer cache can be resized, keeps working at its
+// smallest, and counts hits
+void
+bcachetest(void)
+{
+  struct sysinfo before, after;
+  int fd, i, n, nbuf;
+
+  printf(stdout, "bcache test\n");
+  nbuf = bcachesize(0);
+  if(nbuf < NBUF || bcachesize(nbuf + 100) < nbuf + 100){
+    printf(stdout, "bcachesize failed to grow\n");
+    exit();
+  }
+  if(bcachesize(NBUF) >= nbuf){
+    printf(stdout, "bcachesize failed to shrink\n");
+    exit();
+  }
+
+  // a file larger than the cache, written and read back
+  sysinfo(&before);
+  unlink("bcachefile");
+  fd = open("bcachefile", O_CREATE|O_RDWR);
+  for(i = 0; i < 4*NBUF; i++){
+    memset(buf, i, 512);
+    if(write(fd, buf, 512) != 512){
+      printf(stdout, "bcache test write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+  fd = open("bcachefile", O_RDONLY);
+  for(i = 0; i < 4*NBUF; i++){
+    n = read(fd, buf, 512);
+    if(n != 512 || buf[0] != (char)i || buf[511] != (char)i){
+      printf(stdout, "bcache test read back block %d wrong\n", i);
+      exit();
+    }
+  }
+  close(fd);
+  unlink("bcachefile");
+  sysinfo(&after);
+  if(after.nbhit == before.nbhit || after.nbmiss == before.nbmiss){
+    printf(stdout, "bcache test counted %d hits %d misses\n",
+           after.nbhit - before.nbhit, after.nbmiss - before.nbmiss);
+    exit();
+  }
+  bcachesize(nbuf);
+  printf(stdout, "bcache test ok\n");
+}
+
+// writes stay in the cache until the flusher, sync or fsync
+// write them back
+void
+synctest(void)
+{
+  struct sysinfo si;
+  int fd, i, fds[2];
+
+  printf(stdout, "sync test\n");
+  unlink("syncfile");
+  fd = open("syncfile", O_CREATE|O_RDWR);
+  for(i = 0; i < 8; i++){
+    memset(buf, i, 512);
+    if(write(fd, buf, 512) != 512){
+      printf(stdout, "sync test write failed\n");
+      exit();
+    }
+  }
+  sysinfo(&si);
+  if(si.nbdirty == 0){
+    printf(stdout, "sync test: writes were not delayed\n");
+    exit();
+  }
+  if(fsync(fd) != 0){
+    printf(stdout, "fsync failed\n");
+    exit();
+  }
+  close(fd);
+  pipe(fds);
+  if(fsync(fds[0]) != -1){
+    printf(stdout, "fsync of a pipe succeeded\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  unlink("syncfile");
+  sync();
+  sysinfo(&si);
+  if(si.nbdirty != 0){
+    printf(stdout, "sync left %d dirty buffers\n", si.nbdirty);
+    exit();
+  }
+  printf(stdout, "sync test ok\n");
+}
+
+// concurrent readers and writers get their own data back under
+// each disk scheduler
+void
+ioschedtest(void)
+{
+  static char *scheds[] = { "fifo", "clook" };
+  struct sysinfo si;
+  char name[3];
+  int s, pid, fd, i, j, nbuf;
+
+  printf(stdout, "iosched test\n");
+  if(iosched("nosuch") != -1){
+    printf(stdout, "iosched accepted a bad name\n");
+    exit();
+  }
+  name[0] = 'q';
+  name[2] = 0;
+  for(s = 0; s < 2; s++){
+    if(iosched(scheds[s]) != 0){
+      printf(stdout, "iosched %s failed\n", scheds[s]);
+      exit();
+    }
+    sysinfo(&si);
+    if(strcmp(si.iosched, scheds[s]) != 0){
+      printf(stdout, "iosched: sysinfo says %s\n", si.iosched);
+      exit();
+    }
+    for(i = 0; i < 3; i++){
+      name[1] = '0' + i;
+      if((pid = fork()) == 0){
+        fd = open(name, O_CREATE|O_RDWR);
+        for(j = 0; j < 16; j++){
+          memset(buf, i*16 + j, 512);
+          write(fd, buf, 512);
+        }
+        fsync(fd);
+        close(fd);
+        exit();
+      }
+    }
+    for(i = 0; i < 3; i++)
+      wait();
+
+    // Read back from the disk, not the cache.
+    nbuf = bcachesize(0);
+    bcachesize(1);
+    bcachesize(nbuf);
+    for(i = 0; i < 3; i++){
+      name[1] = '0' + i;
+      if((pid = fork()) == 0){
+        fd = open(name, O_RDONLY);
+        for(j = 0; j < 16; j++){
+          if(read(fd, buf, 512) != 512 || buf[0] != (char)(i*16 + j) ||
+             buf[511] != (char)(i*16 + j)){
+            printf(stdout, "iosched %s: block %d of %s wrong\n",
+                   scheds[s], j, name);
+            exit();
+          }
+        }
+        close(fd);
+        exit();
+      }
+    }
+    for(i = 0; i < 3; i++)
+      wait();
+    for(i = 0; i < 3; i++){
+      name[1] = '0' + i;
+      unlink(name);
+    }
+  }
+  printf(stdout, "iosched test ok\n");
+}
+
+// mount refuses what it can't mount
+void
+mounttest(void)
+{
+  int fd;
+
+  printf(stdout, "mount test\n");
+  fd = open("mountfile", O_CREATE|O_RDWR);
+  close(fd);
+  if(mount("mountfile", 2) != -1){
+    printf(stdout, "mount on a file succeeded\n");
+    exit();
+  }
+  unlink("mountfile");
+  if(mount("nosuchdir", 2) != -1){
+    printf(stdout, "mount on a missing directory succeeded\n");
+    exit();
+  }
+  if(mkdir("mountdir") != 0){
+    printf(stdout, "mkdir mountdir failed\n");
+    exit();
+  }
+  if(mount("mountdir", 99) != -1 || mount("mountdir", -1) != -1){
+    printf(stdout, "mount of a bad disk number succeeded\n");
+    exit();
+  }
+  if(mount("mountdir", 3) != -1){
+    printf(stdout, "mount of a missing disk succeeded\n");
+    exit();
+  }
+  // disk 0 holds the kernel, whose ELF header is no superblock
+  if(mount("mountdir", 0) != -1){
+    printf(stdout, "mount of the kernel disk succeeded\n");
+    exit();
+  }
+  unlink("mountdir");
+  printf(stdout, "mount test ok\n");
+}
+
+// freed blocks keep their old contents on disk, so a new
+// directory must not see the dirents a deleted file held
+void
+staledirtest(void)
+{
+  struct dirent de[512/sizeof(struct dirent)];
+  char name[12];
+  int fd, i;
+
+  printf(stdout, "stale dir test\n");
+  memset(de, 0, sizeof(de));
+  for(i = 0; i < sizeof(de)/sizeof(de[0]); i++){
+    de[i].inum = 1;
+    strcpy(de[i].name, "zzfake");
+  }
+  fd = open("stalefile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "create stalefile failed\n");
+    exit();
+  }
+  for(i = 0; i < 40; i++){
+    if(write(fd, de, sizeof(de)) != sizeof(de)){
+      printf(stdout, "write stalefile failed\n");
+      exit();
+    }
+  }
+  close(fd);
+  unlink("stalefile");
+
+  // Grow the directory past a block, so dirlink allocates too.
+  if(mkdir("staledir") != 0){
+    printf(stdout, "mkdir staledir failed\n");
+    exit();
+  }
+  strcpy(name, "staledir/xx");
+  for(i = 0; i < 40; i++){
+    name[9] = 'a' + i/26;
+    name[10] = 'a' + i%26;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+      printf(stdout, "create in staledir failed\n");
+      exit();
+    }
+    close(fd);
+  }
+  if(open("staledir/zzfake", O_RDONLY) >= 0 ||
+     unlink("staledir/zzfake") >= 0){
+    printf(stdout, "stale dirent found in a new directory\n");
+    exit();
+  }
+  for(i = 0; i < 40; i++){
+    name[9] = 'a' + i/26;
+    name[10] = 'a' + i%26;
+    unlink(name);
+  }
+  if(unlink("staledir") != 0){
+    printf(stdout, "unlink staledir failed\n");
+    exit();
+  }
+  printf(stdout, "stale dir test ok\n");
+}
+
+// the directory entry cache follows creates, unlinks and
+// removed directories, and answers repeated lookups
+void
+dcachetest(void)
+{
+  struct sysinfo before, after;
+  struct stat st;
+  int fd, i;
+
+  printf(stdout, "dcache test\n");
+  if(mkdir("dcd") != 0 || mkdir("dcd/sub") != 0){
+    printf(stdout, "mkdir dcd failed\n");
+    exit();
+  }
+  if(open("dcd/sub/f", O_RDONLY) >= 0){
+    printf(stdout, "open of a missing file succeeded\n");
+    exit();
+  }
+  fd = open("dcd/sub/f", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "create after a failed open failed\n");
+    exit();
+  }
+  close(fd);
+
+  sysinfo(&before);
+  for(i = 0; i < 10; i++){
+    if(stat("dcd/sub/f", &st) < 0 || stat("dcd/sub/nof", &st) >= 0){
+      printf(stdout, "repeated lookup wrong\n");
+      exit();
+    }
+  }
+  sysinfo(&after);
+  if(after.ndcmiss - before.ndcmiss > 3){
+    printf(stdout, "repeated lookups missed the cache %d times\n",
+           after.ndcmiss - before.ndcmiss);
+    exit();
+  }
+
+  if(unlink("dcd/sub/f") != 0 || open("dcd/sub/f", O_RDONLY) >= 0){
+    printf(stdout, "unlinked file still found\n");
+    exit();
+  }
+  fd = open("dcd/sub/f", O_CREATE|O_RDWR);
+  close(fd);
+  if(unlink("dcd/sub/f") != 0 || unlink("dcd/sub") != 0){
+    printf(stdout, "unlink dcd/sub failed\n");
+    exit();
+  }
+  sync();  // let the directory's inode be freed
+  if(mkdir("dcd/sub") != 0 || open("dcd/sub/f", O_RDONLY) >= 0){
+    printf(stdout, "new directory has the old one's file\n");
+    exit();
+  }
+  if(unlink("dcd/sub") != 0 || unlink("dcd") != 0){
+    printf(stdout, "unlink dcd failed\n");
+    exit();
+  }
+  printf(stdout, "dcache test ok\n");
+}
+
+void
+hdname(char *path, int i)
+{
+  strcpy(path, "hd/h");
+  path[4] = '0' + i/1000;
+  path[5] = '0' + i/100%10;
+  path[6] = '0' + i/10%10;
+  path[7] = '0' + i%10;
+  path[8] = 0;
+}
+
+// Link names into hd until it is full.  Returns how many went in.
+int
+hdfill(void)
+{
+  char path[9];
+  int n;
+
+  for(n = 0; n < 9000; n++){
+    hdname(path, n);
+    if(link("hd/f", path) != 0)
+      break;
+  }
+  return n;
+}
+
+// Look up nmiss names that aren't in hd, and return how many
+// blocks that read, cached or not.
+int
+hdmissreads(int first, int nmiss)
+{
+  struct sysinfo before, after;
+  struct stat st;
+  char path[9];
+  int i;
+
+  sync();  // nothing else reading blocks meanwhile
+  sysinfo(&before);
+  for(i = first; i < first + nmiss; i++){
+    hdname(path, i);
+    if(stat(path, &st) >= 0){
+      printf(stdout, "%s found but never linked\n", path);
+      exit();
+    }
+  }
+  sysinfo(&after);
+  return (after.nbhit + after.nbmiss) - (before.nbhit + before.nbmiss);
+}
+
+// a hashed directory grows past one table of blocks, refuses a
+// link cleanly when full, keeps finding every entry, and looks
+// up a missing name in a bounded number of block reads after
+// being filled, emptied and filled again
+void
+hashdirtest(void)
+{
+  struct stat st;
+  char path[9];
+  int i, n, m, reads;
+
+  printf(stdout, "hashdir test\n");
+  if(mkhashdir("hd") != 0){
+    printf(stdout, "mkhashdir failed\n");
+    exit();
+  }
+  close(open("hd/f", O_CREATE|O_RDWR));
+
+  n = hdfill();
+  // Old plain directories held 4480 entries; the full table
+  // must at least pass the 2048 of a fixed one of 64 blocks.
+  if(n <= 2048 || n >= 9000){
+    printf(stdout, "hashed directory took %d entries\n", n);
+    exit();
+  }
+  hdname(path, n);
+  if(link("hd/f", path) != -1 || stat(path, &st) >= 0){
+    printf(stdout, "link into a full directory didn't fail cleanly\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    hdname(path, i);
+    if(stat(path, &st) < 0 || st.nlink != n + 1){
+      printf(stdout, "%s lost in a full directory\n", path);
+      exit();
+    }
+  }
+  // A miss reads the header, one block, and maybe the indirect
+  // block, whatever the size.
+  if((reads = hdmissreads(n + 1, 50)) > 50*4){
+    printf(stdout, "50 misses in a full directory read %d blocks\n", reads);
+    exit();
+  }
+
+  for(i = 0; i < n; i++){
+    hdname(path, i);
+    if(unlink(path) != 0){
+      printf(stdout, "unlink %s failed\n", path);
+      exit();
+    }
+  }
+  if(stat("hd/h0000", &st) >= 0 || (reads = hdmissreads(n + 51, 50)) > 50*4){
+    printf(stdout, "emptied directory: misses read %d blocks\n", reads);
+    exit();
+  }
+
+  // Filling again finds the blocks already split.
+  if((m = hdfill()) != n){
+    printf(stdout, "refilled directory took %d entries, not %d\n", m, n);
+    exit();
+  }
+  if((reads = hdmissreads(n + 101, 50)) > 50*4){
+    printf(stdout, "refilled directory: misses read %d blocks\n", reads);
+    exit();
+  }
+  if(unlink("hd") == 0){
+    printf(stdout, "unlinked a hashed directory that isn't empty\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    hdname(path, i);
+    unlink(path);
+  }
+  if(unlink("hd/f") != 0 || unlink("hd") != 0){
+    printf(stdout, "unlink hd failed\n");
+    exit();
+  }
+  printf(stdout, "hashdir test ok\n");
+}
+
+// grow past free memory: do the extra pages go out to swap
+// and come back intact?
+void
+swaptest(void)
+{
+  struct sysinfo before, after;
+  char *start, *a;
+  uint n;
+
+  printf(stdout, "swap test\n");
+  sysinfo(&before);
+  n = before.freeram + before.freeswap / 2;
+  start = sbrk(n);
+  if(start == (char*)0xffffffff){
+    printf(stdout, "swap test sbrk %d failed\n", n);
+    exit();
+  }
+  for(a = start; a < start + n; a += PAGE)
+    *(uint*)a = (uint)a;
+  for(a = start; a < start + n; a += PAGE){
+    if(*(uint*)a != (uint)a){
+      printf(stdout, "swap test page %x came back wrong\n", a);
+      exit();
+    }
+  }
+  sysinfo(&after);
+  if(after.nswapout == before.nswapout || after.nswapin == before.nswapin){
+    printf(stdout, "swap test did not swap, %d out %d in\n",
+           after.nswapout - before.nswapout, after.nswapin - before.nswapin);
+    exit();
+  }
+  sbrk(-n);
+  sysinfo(&after);
+  if(after.freeswap != before.freeswap){
+    printf(stdout, "swap test leaked swap, %d then %d free\n",
+           before.freeswap, after.freeswap);
+    exit();
+  }
+  printf(stdout, "swap test ok\n");
+}
+
 // does exec do something sensible if the arguments
 // are larger than a page?
 void
@@ -1492,6 +2327,20 @@ main(int argc, char *argv[])
 
   bigargtest();
   bsstest();
+  sysinfotest();
+  swaptest();
+  shmtest();
+  mmaptest();
+  threadtest();
+  futextest();
+  fputest();
+  bcachetest();
+  synctest();
+  ioschedtest();
+  mounttest();
+  staledirtest();
+  dcachetest();
+  hashdirtest();
   sbrktest();
   validatetest();
 
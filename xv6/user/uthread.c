@@ -0,0 +1,38 @@
+// User-level threads on top of clone and join.
+
+#include "types.h"
+#include "user.h"
+
+#define TSTACK 4096  // thread stack size; clone wants one aligned page
+
+// Run fn(arg) in a new thread, on a stack from malloc.  fn must
+// call exit() rather than return.  Returns the thread's pid,
+// or -1.  malloc is not thread safe: create threads from one
+// thread only.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  char *mem, *stack;
+  int pid;
+
+  if((mem = malloc(2*TSTACK)) == 0)
+    return -1;
+  stack = (char*)(((uint)mem + TSTACK - 1) & ~(TSTACK - 1));
+  *(char**)stack = mem;  // the bottom word, for thread_join
+  if((pid = clone(fn, arg, stack)) < 0)
+    free(mem);
+  return pid;
+}
+
+// Wait for a thread to exit and free its stack.
+// Returns its pid, or -1 if there are no threads.
+int
+thread_join(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) >= 0)
+    free(*(char**)stack);
+  return pid;
+}